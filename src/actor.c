@@ -0,0 +1,158 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+
+#include "actor.h"
+
+LOG_MODULE_REGISTER(actor, LOG_LEVEL_INF);
+
+/*
+ * Priority map, most urgent first: control (actuators), sensor ingestion,
+ * housekeeping, Bluetooth management. Each level preempts the ones below it,
+ * so an LED pattern or a slow GATT operation never delays a CAN frame or an
+ * IMU frame, and a blocking controller call never delays any of them.
+ */
+BUILD_ASSERT(CONFIG_APP_ACTOR_RT_PRIORITY < CONFIG_APP_ACTOR_SENSOR_PRIORITY &&
+	     CONFIG_APP_ACTOR_SENSOR_PRIORITY < CONFIG_APP_ACTOR_BG_PRIORITY &&
+	     CONFIG_APP_ACTOR_BG_PRIORITY < CONFIG_APP_ACTOR_BT_PRIORITY,
+	     "actor queue priorities must be control < sensor < housekeeping < bluetooth");
+
+K_THREAD_STACK_DEFINE(actor_rt_stack, CONFIG_APP_ACTOR_RT_STACK_SIZE);
+K_THREAD_STACK_DEFINE(actor_sensor_stack, CONFIG_APP_ACTOR_SENSOR_STACK_SIZE);
+K_THREAD_STACK_DEFINE(actor_bg_stack, CONFIG_APP_ACTOR_BG_STACK_SIZE);
+K_THREAD_STACK_DEFINE(actor_bt_stack, CONFIG_APP_ACTOR_BT_STACK_SIZE);
+
+struct k_work_q actor_rt_q;
+struct k_work_q actor_sensor_q;
+struct k_work_q actor_bg_q;
+struct k_work_q actor_bt_q;
+
+static void actor_run(struct actor *actor, uint32_t msgs, uint32_t released)
+{
+	uint32_t latency;
+
+	if (!msgs) {
+		return;
+	}
+	actor->handler(actor, msgs);
+
+	latency = k_cyc_to_us_floor32(k_cycle_get_32() - released);
+	actor->runs++;
+	if (latency > actor->max_latency) {
+		actor->max_latency = latency;
+	}
+	if (actor->deadline_us && latency > actor->deadline_us) {
+		atomic_inc(&actor->misses);
+		LOG_DBG("%s missed deadline: %u us", actor->name, latency);
+	}
+}
+
+static void actor_work_handler(struct k_work *work)
+{
+	struct actor *actor = CONTAINER_OF(work, struct actor, work);
+	uint32_t released = atomic_get(&actor->released);
+
+	actor_run(actor, atomic_clear(&actor->mailbox), released);
+}
+
+static void actor_timer_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct actor *actor = CONTAINER_OF(dwork, struct actor, timer);
+	uint32_t released = atomic_get(&actor->released);
+
+	/* Pick up anything posted immediately as well, both run on this queue. */
+	if (atomic_or(&actor->mailbox, atomic_clear(&actor->timer_msgs)) == 0) {
+		released = atomic_get(&actor->timer_due);
+	}
+	actor_run(actor, atomic_clear(&actor->mailbox), released);
+}
+
+static int actor_init(void)
+{
+	const struct k_work_queue_config rt_cfg = {
+		.name = "actor_rt",
+	};
+	const struct k_work_queue_config sensor_cfg = {
+		.name = "actor_sensor",
+	};
+	const struct k_work_queue_config bg_cfg = {
+		.name = "actor_bg",
+	};
+	const struct k_work_queue_config bt_cfg = {
+		.name = "actor_bt",
+	};
+
+	STRUCT_SECTION_FOREACH(actor, actor) {
+		k_work_init(&actor->work, actor_work_handler);
+		k_work_init_delayable(&actor->timer, actor_timer_handler);
+	}
+
+	k_work_queue_start(&actor_rt_q, actor_rt_stack, K_THREAD_STACK_SIZEOF(actor_rt_stack),
+			   CONFIG_APP_ACTOR_RT_PRIORITY, &rt_cfg);
+	k_work_queue_start(&actor_sensor_q, actor_sensor_stack,
+			   K_THREAD_STACK_SIZEOF(actor_sensor_stack),
+			   CONFIG_APP_ACTOR_SENSOR_PRIORITY, &sensor_cfg);
+	k_work_queue_start(&actor_bg_q, actor_bg_stack, K_THREAD_STACK_SIZEOF(actor_bg_stack),
+			   CONFIG_APP_ACTOR_BG_PRIORITY, &bg_cfg);
+	k_work_queue_start(&actor_bt_q, actor_bt_stack, K_THREAD_STACK_SIZEOF(actor_bt_stack),
+			   CONFIG_APP_ACTOR_BT_PRIORITY, &bt_cfg);
+
+	LOG_DBG("actor queues started");
+	return 0;
+}
+
+/* Queues must be running before any APPLICATION level init posts to them. */
+SYS_INIT(actor_init, POST_KERNEL, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static const char *queue_name(const struct k_work_q *queue)
+{
+	if (queue == &actor_rt_q) {
+		return "actor_rt";
+	}
+	if (queue == &actor_sensor_q) {
+		return "actor_sensor";
+	}
+	if (queue == &actor_bt_q) {
+		return "actor_bt";
+	}
+	return "actor_bg";
+}
+
+static int cmd_actors_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%-16s %-13s %8s %10s %10s %6s", "actor", "queue", "runs",
+		    "max [us]", "dl [us]", "miss");
+	STRUCT_SECTION_FOREACH(actor, actor) {
+		shell_print(sh, "%-16s %-13s %8u %10u %10u %6ld", actor->name,
+			    queue_name(actor->queue),
+			    actor->runs, actor->max_latency, actor->deadline_us,
+			    atomic_get(&actor->misses));
+	}
+	return 0;
+}
+
+static int cmd_actors_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	STRUCT_SECTION_FOREACH(actor, actor) {
+		actor->runs = 0;
+		actor->max_latency = 0;
+		atomic_clear(&actor->misses);
+	}
+	shell_print(sh, "actor statistics cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(actors_subcmd,
+	SHELL_CMD(reset, NULL, "Clear run and deadline statistics", cmd_actors_reset),
+	SHELL_CMD(show, NULL, "Runs, worst latency and deadline misses per actor", cmd_actors_show),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(actors, &actors_subcmd, "Actor scheduling statistics", NULL);
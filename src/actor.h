@@ -0,0 +1,86 @@
+#ifndef _ACTOR_H_
+#define _ACTOR_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/iterable_sections.h>
+
+/*
+ * Actors are message handlers that share a small set of work queues instead
+ * of owning a thread each. Messages are bits in a mailbox, so a module keeps
+ * its existing flag enum: posting sets the bit and submits the actor, and
+ * the handler receives every bit that was set since it last ran. An actor
+ * never runs concurrently with itself.
+ *
+ * Each actor may declare a deadline: the time from the first message being
+ * posted (or a delayed message falling due) until the handler returns.
+ * Runs that take longer are counted as misses.
+ */
+
+struct actor;
+
+typedef void (*actor_handler_t)(struct actor *actor, uint32_t msgs);
+
+struct actor {
+	const char *name;
+	struct k_work_q *queue;
+	actor_handler_t handler;
+	atomic_t mailbox;
+	atomic_t timer_msgs;
+	/* Set up by actor_init(), before any application init posts. */
+	struct k_work work;
+	struct k_work_delayable timer;
+	/* Deadline bookkeeping, deadline_us of 0 disables miss counting. */
+	uint32_t deadline_us;
+	atomic_t released;
+	atomic_t timer_due;
+	uint32_t runs;
+	uint32_t max_latency;
+	atomic_t misses;
+};
+
+/* Control path: power/motor events and CAN. */
+extern struct k_work_q actor_rt_q;
+/* Sensor ingestion: IMU frames and the loadcell. */
+extern struct k_work_q actor_sensor_q;
+/* Housekeeping: LEDs, advertising, GATT subscription. */
+extern struct k_work_q actor_bg_q;
+/* Bluetooth management: enable, scan and connect, HCI polls. May block. */
+extern struct k_work_q actor_bt_q;
+
+#define ACTOR_DEFINE(_name, _queue, _handler, _deadline_us)                    \
+	STRUCT_SECTION_ITERABLE(actor, _name) = {                              \
+		.name = #_name,                                                \
+		.queue = &_queue,                                              \
+		.handler = _handler,                                           \
+		.deadline_us = _deadline_us,                                   \
+	}
+
+/* Deliver msg as soon as the actor's queue gets to it. ISR safe. */
+static inline void actor_post(struct actor *actor, uint32_t msg)
+{
+	/* The first message of a batch releases the job. */
+	if (atomic_or(&actor->mailbox, BIT(msg)) == 0) {
+		atomic_set(&actor->released, k_cycle_get_32());
+	}
+	k_work_submit_to_queue(actor->queue, &actor->work);
+}
+
+/*
+ * Deliver msg after delay. Each actor has one timer, re-arming it replaces
+ * the previous deadline. ISR safe.
+ */
+static inline void actor_post_delayed(struct actor *actor, uint32_t msg, k_timeout_t delay)
+{
+	atomic_or(&actor->timer_msgs, BIT(msg));
+	atomic_set(&actor->timer_due, k_cycle_get_32() + k_ticks_to_cyc_floor32(delay.ticks));
+	k_work_reschedule_for_queue(actor->queue, &actor->timer, delay);
+}
+
+static inline void actor_cancel_delayed(struct actor *actor)
+{
+	k_work_cancel_delayable(&actor->timer);
+	atomic_clear(&actor->timer_msgs);
+}
+
+#endif /* _ACTOR_H_ */
@@ -0,0 +1,161 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/cache.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tcm.h"
+
+LOG_MODULE_REGISTER(bench, LOG_LEVEL_INF);
+
+#define BENCH_ITERATIONS_DEFAULT 1000
+#define BENCH_STREAM_LEN 1024
+
+static volatile uint32_t bench_hits;
+
+static uint32_t cycles_to_ns(uint64_t cycles, uint32_t n)
+{
+	return (uint32_t)(k_cyc_to_ns_floor64(cycles) / n);
+}
+
+static int cmd_bench_event(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t n = BENCH_ITERATIONS_DEFAULT;
+	uint32_t settings_cycles, bus_cycles, hits;
+
+	if (argc > 1) {
+		n = strtoul(argv[1], NULL, 0);
+		if (n == 0) {
+			shell_error(sh, "invalid iteration count");
+			return -EINVAL;
+		}
+	}
+
+	settings_cycles = bench_event_settings(n, &hits);
+	if (hits != n) {
+		shell_error(sh, "settings path dispatched %u/%u", hits, n);
+		return -EIO;
+	}
+
+	bus_cycles = bench_event_zbus(n, &hits);
+	if (hits != n) {
+		shell_error(sh, "bus path dispatched %u/%u", hits, n);
+		return -EIO;
+	}
+
+	shell_print(sh, "event dispatch, %u iterations", n);
+	shell_print(sh, "  settings_runtime_set: %u ns/event", cycles_to_ns(settings_cycles, n));
+	shell_print(sh, "  zbus channel:         %u ns/event", cycles_to_ns(bus_cycles, n));
+	return 0;
+}
+
+/*
+ * The IMU frame scan, built twice: once in default flash/SRAM placement and
+ * once in ITCM working on a DTCM copy of the stream, to measure what the TCM
+ * placement buys independent of the UART. The body is forced inline so
+ * each copy really runs from its own memory.
+ */
+static ALWAYS_INLINE uint32_t scan_frames(const uint8_t *buf, size_t len)
+{
+	uint32_t frames = 0;
+	uint8_t sum;
+
+	for (size_t i = 0; i + CONFIG_APP_IMU_FRAME_LEN <= len; i++) {
+		if (buf[i] != CONFIG_APP_IMU_FRAME_SYNC) {
+			continue;
+		}
+		sum = 0;
+		for (int j = 0; j < CONFIG_APP_IMU_FRAME_LEN - 1; j++) {
+			sum += buf[i + j];
+		}
+		if (sum == buf[i + CONFIG_APP_IMU_FRAME_LEN - 1]) {
+			frames++;
+			i += CONFIG_APP_IMU_FRAME_LEN - 1;
+		}
+	}
+	return frames;
+}
+
+static __noinline uint32_t scan_default(const uint8_t *buf, size_t len)
+{
+	return scan_frames(buf, len);
+}
+
+static __app_itcm __noinline uint32_t scan_tcm(const uint8_t *buf, size_t len)
+{
+	return scan_frames(buf, len);
+}
+
+static uint8_t stream_sram[BENCH_STREAM_LEN];
+static uint8_t stream_tcm[BENCH_STREAM_LEN] __app_dtcm_bss;
+
+static void fill_stream(uint8_t *buf)
+{
+	for (size_t i = 0; i + CONFIG_APP_IMU_FRAME_LEN <= BENCH_STREAM_LEN;
+	     i += CONFIG_APP_IMU_FRAME_LEN) {
+		uint8_t sum = CONFIG_APP_IMU_FRAME_SYNC;
+
+		buf[i] = CONFIG_APP_IMU_FRAME_SYNC;
+		for (int j = 1; j < CONFIG_APP_IMU_FRAME_LEN - 1; j++) {
+			buf[i + j] = (uint8_t)(i + j);
+			sum += buf[i + j];
+		}
+		buf[i + CONFIG_APP_IMU_FRAME_LEN - 1] = sum;
+	}
+}
+
+static uint32_t time_scan(uint32_t (*scan)(const uint8_t *, size_t), const uint8_t *buf,
+			  uint32_t n, bool cold)
+{
+	uint64_t total = 0;
+	uint32_t start;
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (cold) {
+			sys_cache_instr_invd_all();
+			sys_cache_data_flush_and_invd_all();
+		}
+		start = k_cycle_get_32();
+		bench_hits += scan(buf, BENCH_STREAM_LEN);
+		total += k_cycle_get_32() - start;
+	}
+	return (uint32_t)(total / n);
+}
+
+static int cmd_bench_tcm(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t n = 100;
+
+	if (argc > 1) {
+		n = strtoul(argv[1], NULL, 0);
+		if (n == 0) {
+			shell_error(sh, "invalid iteration count");
+			return -EINVAL;
+		}
+	}
+
+	fill_stream(stream_sram);
+	fill_stream(stream_tcm);
+
+	shell_print(sh, "IMU frame scan over %u bytes, %u iterations (ITCM %s, DTCM %s)",
+		    BENCH_STREAM_LEN, n, IS_ENABLED(CONFIG_APP_ITCM) ? "on" : "off",
+		    IS_ENABLED(CONFIG_APP_DTCM) ? "on" : "off");
+	shell_print(sh, "                   warm [cyc]  cold [cyc]");
+	shell_print(sh, "  flash + SRAM:    %10u  %10u",
+		    time_scan(scan_default, stream_sram, n, false),
+		    time_scan(scan_default, stream_sram, n, true));
+	shell_print(sh, "  ITCM + DTCM:     %10u  %10u",
+		    time_scan(scan_tcm, stream_tcm, n, false),
+		    time_scan(scan_tcm, stream_tcm, n, true));
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(bench_subcmd,
+	SHELL_CMD_ARG(event, NULL, "[iterations]\n\nCompare settings and bus event dispatch",
+		      cmd_bench_event, 1, 1),
+	SHELL_CMD_ARG(tcm, NULL, "[iterations]\n\nCompare the IMU frame scan in flash and TCM",
+		      cmd_bench_tcm, 1, 1),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(bench, &bench_subcmd, "Micro-benchmarks", NULL);
@@ -0,0 +1,14 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Dispatch n pairing complete events through settings_runtime_set() or a
+ * zbus channel. Returns the cycles taken; hits is set to the events that
+ * reached their handler.
+ */
+uint32_t bench_event_settings(uint32_t n, uint32_t *hits);
+uint32_t bench_event_zbus(uint32_t n, uint32_t *hits);
+
+#endif /* _BENCH_H_ */
@@ -0,0 +1,100 @@
+/*
+ * Event dispatch loops shared by "bench event" and the tests/bench suite:
+ * the old settings_runtime_set string path and a zbus channel publish, each
+ * delivering a pairing complete event.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
+#include <string.h>
+
+#include "channels.h"
+#include "bench.h"
+
+static volatile uint32_t bench_hits;
+
+/*
+ * Same shape as the old "event" subtree handler: the name is split with
+ * settings_name_next() and matched against a strncmp chain, the hit being
+ * the last entry in the chain as "event/pairing_complete" used to be.
+ */
+static int bench_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	size_t name_len;
+
+	name_len = settings_name_next(name, &next);
+	if (!next) {
+		if (!strncmp(name, "button_a", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "button_b", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "button_ab", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "button_a_long", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "button_b_long", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "fsr_connection", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "controller_connection", name_len)) {
+			return 0;
+		}
+		if (!strncmp(name, "pairing_complete", name_len)) {
+			bench_hits++;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+SETTINGS_STATIC_HANDLER_DEFINE(bench, "bench", NULL, bench_handle_set, NULL, NULL);
+
+static void bench_listener(const struct zbus_channel *chan)
+{
+	const struct pairing_msg *msg = zbus_chan_const_msg(chan);
+
+	if (msg->complete) {
+		bench_hits++;
+	}
+}
+
+ZBUS_LISTENER_DEFINE(bench_lis, bench_listener);
+
+ZBUS_CHAN_DEFINE(bench_chan, struct pairing_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(bench_lis), ZBUS_MSG_INIT(0));
+
+uint32_t bench_event_settings(uint32_t n, uint32_t *hits)
+{
+	uint32_t start, cycles;
+
+	bench_hits = 0;
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < n; i++) {
+		settings_runtime_set("bench/pairing_complete", NULL, 0);
+	}
+	cycles = k_cycle_get_32() - start;
+	*hits = bench_hits;
+	return cycles;
+}
+
+uint32_t bench_event_zbus(uint32_t n, uint32_t *hits)
+{
+	struct pairing_msg msg = { .complete = true };
+	uint32_t start, cycles;
+
+	bench_hits = 0;
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < n; i++) {
+		zbus_chan_pub(&bench_chan, &msg, K_NO_WAIT);
+	}
+	cycles = k_cycle_get_32() - start;
+	*hits = bench_hits;
+	return cycles;
+}
@@ -0,0 +1,120 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+
+#include "boot.h"
+
+LOG_MODULE_REGISTER(boot, LOG_LEVEL_INF);
+
+K_THREAD_STACK_DEFINE(boot_stack, CONFIG_APP_BOOT_WORKQ_STACK_SIZE);
+static struct k_work_q boot_q;
+
+static const char *const stage_names[BOOT_STAGE_NUM] = {
+	[BOOT_KERNEL] = "kernel",
+	[BOOT_APP_INIT] = "app_init",
+	[BOOT_SDCARD] = "sdcard",
+	[BOOT_SETTINGS] = "settings",
+	[BOOT_BT_POWER] = "bt_power",
+	[BOOT_BT_FIRMWARE] = "bt_firmware",
+	[BOOT_BT_ENABLE] = "bt_enable",
+	[BOOT_BT_LOAD] = "bt_load",
+};
+
+static struct {
+	uint32_t begin_us;
+	uint32_t end_us;
+	int err;
+	const char *thread;
+} stages[BOOT_STAGE_NUM];
+
+static K_EVENT_DEFINE(stage_done);
+
+BUILD_ASSERT(BOOT_STAGE_NUM <= 32, "boot stages must fit in one event mask");
+
+static uint32_t boot_now_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+void boot_stage_begin(enum boot_stage stage)
+{
+	const char *name = k_thread_name_get(k_current_get());
+
+	stages[stage].begin_us = boot_now_us();
+	stages[stage].thread = name ? name : "?";
+}
+
+void boot_stage_end(enum boot_stage stage, int err)
+{
+	stages[stage].end_us = boot_now_us();
+	stages[stage].err = err;
+	LOG_DBG("%s: %u us", stage_names[stage], stages[stage].end_us - stages[stage].begin_us);
+	k_event_post(&stage_done, BIT(stage));
+}
+
+int boot_stage_wait(enum boot_stage stage, k_timeout_t timeout)
+{
+	if (!k_event_wait(&stage_done, BIT(stage), false, timeout)) {
+		return -EAGAIN;
+	}
+	return stages[stage].err;
+}
+
+void boot_defer(struct k_work *work)
+{
+	k_work_submit_to_queue(&boot_q, work);
+}
+
+static int boot_init(void)
+{
+	const struct k_work_queue_config cfg = {
+		.name = "boot_init",
+	};
+
+	/* Everything before the first application init is the kernel's. */
+	stages[BOOT_KERNEL].thread = "main";
+	boot_stage_end(BOOT_KERNEL, 0);
+	boot_stage_begin(BOOT_APP_INIT);
+
+	k_work_queue_start(&boot_q, boot_stack, K_THREAD_STACK_SIZEOF(boot_stack),
+			   CONFIG_APP_BOOT_WORKQ_PRIORITY, &cfg);
+	return 0;
+}
+
+/* Ahead of every other application init, they may defer work. */
+SYS_INIT(boot_init, APPLICATION, 0);
+
+static int cmd_boot_times(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t done = k_event_test(&stage_done, BIT_MASK(BOOT_STAGE_NUM));
+	uint32_t ready = 0;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%-12s %10s %10s %10s %4s  %s", "stage", "begin [ms]", "end [ms]",
+		    "took [ms]", "err", "thread");
+	for (int i = 0; i < BOOT_STAGE_NUM; i++) {
+		if (!(done & BIT(i))) {
+			shell_print(sh, "%-12s %10s", stage_names[i],
+				    stages[i].thread ? "running" : "-");
+			continue;
+		}
+		shell_print(sh, "%-12s %6u.%03u %6u.%03u %6u.%03u %4d  %s", stage_names[i],
+			    stages[i].begin_us / 1000, stages[i].begin_us % 1000,
+			    stages[i].end_us / 1000, stages[i].end_us % 1000,
+			    (stages[i].end_us - stages[i].begin_us) / 1000,
+			    (stages[i].end_us - stages[i].begin_us) % 1000, stages[i].err,
+			    stages[i].thread);
+		ready = MAX(ready, stages[i].end_us);
+	}
+	shell_print(sh, "ready after %u.%03u ms", ready / 1000, ready % 1000);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(boot_subcmd,
+	SHELL_CMD(times, NULL, "Begin, end and duration of each init stage", cmd_boot_times),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(boot, &boot_subcmd, "Boot commands", NULL);
@@ -0,0 +1,36 @@
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Boot stage timestamps and the deferred-init queue.
+ *
+ * Slow, independent init steps (SD card mount, settings storage) are
+ * submitted to the deferred-init queue instead of running inside SYS_INIT,
+ * so they overlap with the Bluetooth controller power-up and firmware
+ * download. A step that depends on another waits for its stage to end.
+ */
+
+enum boot_stage {
+	BOOT_KERNEL,		/* reset to the first application init */
+	BOOT_APP_INIT,		/* application SYS_INITs up to main() */
+	BOOT_SDCARD,		/* SD card init and FAT mount */
+	BOOT_SETTINGS,		/* settings storage init and device address */
+	BOOT_BT_POWER,		/* CYW43 power cycle and first HCI reset */
+	BOOT_BT_FIRMWARE,	/* patchram download over HCI */
+	BOOT_BT_ENABLE,		/* bt_enable() as a whole */
+	BOOT_BT_LOAD,		/* settings_load() of bonds and config */
+	BOOT_STAGE_NUM,
+};
+
+void boot_stage_begin(enum boot_stage stage);
+void boot_stage_end(enum boot_stage stage, int err);
+
+/* Wait for a stage to end; returns its result, or -EAGAIN on timeout. */
+int boot_stage_wait(enum boot_stage stage, k_timeout_t timeout);
+
+/* Run work on the deferred-init queue. */
+void boot_defer(struct k_work *work);
+
+#endif /* _BOOT_H_ */
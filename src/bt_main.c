@@ -10,18 +10,21 @@
 #include <zephyr/bluetooth/services/bas.h>
 
 #include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/random/random.h>
+#include <zephyr/shell/shell.h>
+#include <stdio.h>
 #include <string.h>
 #include "bt_main.h"
 #include "config_svc.h"
+#include "channels.h"
+#include "actor.h"
+#include "boot.h"
 
 LOG_MODULE_REGISTER(bt_main, LOG_LEVEL_INF);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
-
 #define MFG_DATA_LEN 2
 #define MFG_FLAG_PAIRING 0x8000
 
@@ -30,18 +33,32 @@ LOG_MODULE_REGISTER(bt_main, LOG_LEVEL_INF);
 									BT_GAP_SCAN_FAST_INTERVAL, \
 									BT_GAP_SCAN_FAST_WINDOW)
 #define SCAN_DELAY K_MSEC(500)
+#define SETTINGS_WAIT K_SECONDS(5)
 
 
 enum state_flag {
+	FLAG_START,
+	FLAG_STOP,
 	FLAG_SCAN,
 	FLAG_SLEEP_BEFORE_SCAN,
 	FLAG_PAIR,
 	FLAG_PAIRING_COMPLETE,
+	FLAG_BOND,
 	FLAG_NUM,
 };
 
-static ATOMIC_DEFINE(flag, FLAG_NUM);
-K_SEM_DEFINE(bt_sem, 0, 1);
+static void bt_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(bt_actor, actor_bt_q, bt_handler, 0);
+
+enum link_flag {
+	FLAG_RSSI,
+};
+
+/* Own actor so the RSSI poll timer does not replace the scan timer. */
+static void link_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(link_actor, actor_bt_q, link_handler, 0);
+#define RSSI_PERIOD K_MSEC(CONFIG_APP_LINK_RSSI_PERIOD_MS)
+static bool bt_started;
 
 static struct gatt_client *clients[] = {
 #ifdef CONFIG_HAS_BLE_FSR
@@ -55,9 +72,19 @@ static struct gatt_client *clients[] = {
 
 static bool is_pairing = false;
 static bt_addr_le_t bond_addrs[CONFIG_BT_MAX_PAIRED] = {0};
+/* Clients whose bonded address the pending auto-connect is waiting for. */
+static uint32_t accept_mask;
+/* Connection parameters the pending auto-connect was started with. */
+static struct bt_le_conn_param accept_param;
 struct k_work_delayable pairing_timeout_work;
 #define PAIRING_TIMEOUT K_SECONDS(CONFIG_PAIRING_TIMEOUT)
 
+/* Parser state for one advertising report. */
+struct adv_ctx {
+	const bt_addr_le_t *addr;
+	uint16_t mfg_data;
+};
+
 static void copy_bonded_addr(const struct bt_bond_info *info, void *data)
 {
 	int *count = (int *)data;
@@ -72,6 +99,8 @@ static void copy_bonded_addr(const struct bt_bond_info *info, void *data)
 static void load_bonded_addresses(void)
 {
 	int bonded_count = 0;
+
+	memset(bond_addrs, 0, sizeof(bond_addrs));
 	bt_foreach_bond(BT_ID_DEFAULT, copy_bonded_addr, &bonded_count);
 	LOG_INF("Loaded %u bonded addresses", bonded_count);
 }
@@ -90,8 +119,7 @@ static bool find_bonded_addr(const bt_addr_le_t *addr)
 static void pairing_timeout(struct k_work *work)
 {
 	LOG_INF("Pairing timeout, stopping scan");
-	atomic_set_bit(flag, FLAG_PAIRING_COMPLETE);
-	k_sem_give(&bt_sem);
+	actor_post(&bt_actor, FLAG_PAIRING_COMPLETE);
 }
 
 
@@ -120,12 +148,179 @@ static struct gatt_client * get_client_by_conn(struct bt_conn *conn)
 	return NULL;
 }
 
+static int get_client_by_addr(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (bt_addr_le_eq(addr, &clients[i]->bond_addr)) {
+			return i;
+		}
+	}
+	return -ENOENT;
+}
+
+/* The stored peer of a client is only used while the bond still exists. */
+static bool client_bonded(const struct gatt_client *client)
+{
+	return !bt_addr_le_eq(&client->bond_addr, BT_ADDR_LE_ANY) &&
+	       find_bonded_addr(&client->bond_addr);
+}
+
+static void remember_bond(struct gatt_client *client, const bt_addr_le_t *addr)
+{
+	if (bt_addr_le_eq(&client->bond_addr, addr)) {
+		return;
+	}
+	bt_addr_le_copy(&client->bond_addr, addr);
+	actor_post(&bt_actor, FLAG_BOND);
+}
+
+static void save_bonds(void)
+{
+	char key[32];
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (bt_addr_le_eq(&clients[i]->bond_addr, BT_ADDR_LE_ANY)) {
+			continue;
+		}
+		snprintf(key, sizeof(key), "bt_main/%s", clients[i]->name);
+		err = settings_save_one(key, &clients[i]->bond_addr, sizeof(bt_addr_le_t));
+		if (err) {
+			LOG_ERR("Failed to save %s (err %d)", key, err);
+		}
+	}
+}
+
+static int bt_main_handle_set(const char *name, size_t len, settings_read_cb read_cb,
+			      void *cb_arg)
+{
+	const char *next;
+	size_t name_len;
+	int rc;
+
+	name_len = settings_name_next(name, &next);
+	if (next || len != sizeof(bt_addr_le_t)) {
+		return -EINVAL;
+	}
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (strlen(clients[i]->name) == name_len &&
+		    !strncmp(name, clients[i]->name, name_len)) {
+			rc = read_cb(cb_arg, &clients[i]->bond_addr, sizeof(bt_addr_le_t));
+			return rc < 0 ? rc : 0;
+		}
+	}
+	return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(bt_main, "bt_main", NULL, bt_main_handle_set, NULL, NULL);
+
+static void stop_auto_connect(void)
+{
+	int err;
+
+	if (!accept_mask) {
+		return;
+	}
+	accept_mask = 0;
+	/* connected() sees the cancelled attempt as BT_HCI_ERR_UNKNOWN_CONN_ID. */
+	err = bt_conn_create_auto_stop();
+	if (err) {
+		LOG_ERR("Failed to stop auto-connect (err %d)", err);
+	}
+}
+
+/*
+ * Put the bonded peers of the disconnected clients in the controller accept
+ * list and let it connect to whichever advertises first. The host sees no
+ * advertising reports in this mode. An attempt already waiting for the same
+ * peers is left running.
+ *
+ * One connection request covers every peer, so it uses the strictest
+ * parameters among them; connected() then asks for the client's own.
+ */
+static int start_auto_connect(uint32_t mask)
+{
+	struct bt_le_conn_param param = {
+		.interval_min = UINT16_MAX,
+		.interval_max = UINT16_MAX,
+		.latency = UINT16_MAX,
+		.timeout = UINT16_MAX,
+	};
+	int err;
+
+	if (mask == accept_mask) {
+		return 0;
+	}
+	stop_auto_connect();
+	bt_le_scan_stop();
+
+	err = bt_le_filter_accept_list_clear();
+	if (err) {
+		return err;
+	}
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (!(mask & BIT(i))) {
+			continue;
+		}
+		err = bt_le_filter_accept_list_add(&clients[i]->bond_addr);
+		if (err) {
+			return err;
+		}
+		param.interval_min = MIN(param.interval_min, clients[i]->conn_param.interval_min);
+		param.interval_max = MIN(param.interval_max, clients[i]->conn_param.interval_max);
+		param.latency = MIN(param.latency, clients[i]->conn_param.latency);
+		param.timeout = MIN(param.timeout, clients[i]->conn_param.timeout);
+	}
+
+	err = bt_conn_le_create_auto(BT_CONN_LE_CREATE_CONN_AUTO, &param);
+	if (err) {
+		return err;
+	}
+	accept_mask = mask;
+	accept_param = param;
+	LOG_INF("Auto-connect started (clients 0x%x)", mask);
+	return 0;
+}
+
+/*
+ * Auto-connect when every disconnected client has a bonded peer on record.
+ * Pairing, and clients bonded before their peer was stored, go through the
+ * advertisement parser instead.
+ */
+static void connect_clients(void)
+{
+	uint32_t missing = 0;
+	uint32_t mask = 0;
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (clients[i]->conn) {
+			continue;
+		}
+		missing |= BIT(i);
+		if (client_bonded(clients[i])) {
+			mask |= BIT(i);
+		}
+	}
+
+	if (!is_pairing && mask && mask == missing) {
+		err = start_auto_connect(mask);
+		if (!err) {
+			return;
+		}
+		LOG_ERR("Auto-connect failed to start (err %d)", err);
+	}
+	stop_auto_connect();
+	start_scan();
+}
+
 static void disconnect_all(void)
 {
 	LOG_INF("Disconnecting all clients");
 	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
 		if (clients[i]->conn) {
 			bt_conn_disconnect(clients[i]->conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			link_stats_disconnected(&clients[i]->stats, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
 			clients[i]->disconnected_cb();
 			bt_conn_unref(clients[i]->conn);
 			clients[i]->conn = NULL;
@@ -135,19 +330,19 @@ static void disconnect_all(void)
 
 static bool eir_found(struct bt_data *data, void *user_data)
 {
-	bt_addr_le_t *addr = user_data;
+	struct adv_ctx *ctx = user_data;
+	const bt_addr_le_t *addr = ctx->addr;
     struct bt_uuid_128 uuid128;
-	static uint16_t mfg_data = 0x0; // Manufacturer data placeholder
 
 	// LOG_INF("[AD]: %u data_len %u", data->type, data->data_len);
 
 	switch (data->type) {
 	case BT_DATA_MANUFACTURER_DATA:
 		if (data->data_len == 2) {
-			mfg_data = sys_get_be16(data->data);
-			// LOG_INF("Manufacturer data found: %04x", mfg_data);
+			ctx->mfg_data = sys_get_be16(data->data);
+			// LOG_INF("Manufacturer data found: %04x", ctx->mfg_data);
 		} else {
-			mfg_data = 0x0; // Reset if data length is not 2
+			ctx->mfg_data = 0x0; // Reset if data length is not 2
 		}
 		break;	
 	case BT_DATA_UUID128_ALL:
@@ -160,7 +355,7 @@ static bool eir_found(struct bt_data *data, void *user_data)
 			if (bt_uuid_cmp(&uuid128.uuid, &clients[i]->uuid->uuid) == 0 && clients[i]->conn == NULL) {
 
 				if (is_pairing) {
-					if (mfg_data & MFG_FLAG_PAIRING) {
+					if (ctx->mfg_data & MFG_FLAG_PAIRING) {
 						LOG_INF("Pairing flag found in manufacturer data, pairing mode active");
 						bt_unpair(BT_ID_DEFAULT, addr);
 					} else {
@@ -168,7 +363,7 @@ static bool eir_found(struct bt_data *data, void *user_data)
 						return false;
 					}
 				} else  {
-					if (find_bonded_addr(addr) && !(mfg_data & MFG_FLAG_PAIRING)) {
+					if (find_bonded_addr(addr) && !(ctx->mfg_data & MFG_FLAG_PAIRING)) {
 						LOG_INF("Found bonded address, proceeding with connection");
 					} else {
 						LOG_INF("Not in pairing mode and no bonded address found");
@@ -182,8 +377,7 @@ static bool eir_found(struct bt_data *data, void *user_data)
 					char addr_str[BT_ADDR_LE_STR_LEN];
 					bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
 					LOG_INF("Create conn to %s failed", addr_str);
-					atomic_set_bit(flag, FLAG_SCAN);
-					k_sem_give(&bt_sem);
+					actor_post(&bt_actor, FLAG_SCAN);
 				}
 				return false;
 			}
@@ -198,6 +392,7 @@ static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
 			 struct net_buf_simple *ad)
 {
 	char addr_str[BT_ADDR_LE_STR_LEN];
+	struct adv_ctx ctx = { .addr = addr };
 
 	if (!scan_required()) {
 		stop_scan();
@@ -211,38 +406,72 @@ static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
 	}
 	bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
 	LOG_DBG("Device found: %s (RSSI %d)", addr_str, rssi);
-	bt_data_parse(ad, eir_found, (void *)addr);
+	bt_data_parse(ad, eir_found, &ctx);
 }
 
 
+static bool is_central(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	return !bt_conn_get_info(conn, &info) && info.role == BT_CONN_ROLE_CENTRAL;
+}
+
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
 	struct gatt_client *client = get_client_by_conn(conn);
+	int index;
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	if (err) {
-		LOG_INF("Failed to connect to %s %u %s", addr, err, bt_hci_err_to_str(err));
 		if (client) {
 			client->conn = NULL;
+			bt_conn_unref(conn);
+		} else if (!is_central(conn)) {
+			return;
+		} else if (err != BT_HCI_ERR_UNKNOWN_CONN_ID) {
+			accept_mask = 0;
 		}
-		bt_conn_unref(conn);
-		atomic_set_bit(flag, FLAG_SCAN);
-		k_sem_give(&bt_sem);
+		/*
+		 * A cancelled auto-connect (unknown conn id) may have been replaced
+		 * already, or stopped for good by stop_auto_connect(). Either way
+		 * connect_clients() re-arms only what is missing.
+		 */
+		LOG_INF("Failed to connect to %s %u %s", addr, err, bt_hci_err_to_str(err));
+		actor_post(&bt_actor, FLAG_SCAN);
 		return;
 	}
 
+	if (client == NULL) {
+		/* Auto-connect hands over a connection nobody holds a reference to yet. */
+		index = get_client_by_addr(bt_conn_get_dst(conn));
+		if (index >= 0 && is_central(conn) && (accept_mask & BIT(index)) &&
+		    !clients[index]->conn) {
+			client = clients[index];
+			client->conn = bt_conn_ref(conn);
+			accept_mask = 0;
+			if (memcmp(&accept_param, &client->conn_param, sizeof(accept_param)) &&
+			    bt_conn_le_param_update(conn, &client->conn_param)) {
+				LOG_WRN("%s: parameter update failed", client->name);
+			}
+		}
+	}
 	if (client == NULL) {
 		LOG_WRN("Service not found for connection");
 		return;
 	}
+	if (!is_pairing && find_bonded_addr(bt_conn_get_dst(conn))) {
+		/* Connected through the parser, auto-connect from now on. */
+		remember_bond(client, bt_conn_get_dst(conn));
+	}
 
+	link_stats_connected(&client->stats, conn);
 	client->connected_cb();
 	LOG_INF("Connected from %s security %d", addr, bt_conn_get_security(conn));
 
-	atomic_set_bit(flag, FLAG_SLEEP_BEFORE_SCAN);
-	k_sem_give(&bt_sem);
+	actor_post_delayed(&bt_actor, FLAG_SCAN, SCAN_DELAY);
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
@@ -255,12 +484,12 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 	LOG_INF("Disconnected: %s, reason 0x%02x %s", addr, reason, bt_hci_err_to_str(reason));
+	link_stats_disconnected(&client->stats, reason);
 	client->disconnected_cb();
 	bt_conn_unref(client->conn);
 	client->conn = NULL;
 
-	atomic_set_bit(flag, FLAG_SCAN);
-	k_sem_give(&bt_sem);
+	actor_post(&bt_actor, FLAG_SCAN);
 }
 
 static bool le_param_req(struct bt_conn *conn,struct bt_le_conn_param *param)
@@ -272,7 +501,12 @@ static bool le_param_req(struct bt_conn *conn,struct bt_le_conn_param *param)
 
 static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout)
 {
+	struct gatt_client *client = get_client_by_conn(conn);
+
 	LOG_INF("LE param updated: interval %d latency %d timeout %d", interval, latency, timeout);
+	if (client) {
+		link_stats_param_updated(&client->stats, interval, latency, timeout);
+	}
 }
 
 static void security_changed(struct bt_conn *conn, bt_security_t level, enum bt_security_err err)
@@ -302,8 +536,15 @@ static struct bt_gatt_cb gatt_callbacks = {
 void pairing_complete(struct bt_conn *conn, bool bonded)
 {
 	char addr_str[BT_ADDR_LE_STR_LEN];
+	struct gatt_client *client;
+
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
 	LOG_INF("Pairing completed: %s, bonded %s", addr_str, bonded ? "yes" : "no");
+
+	client = get_client_by_conn(conn);
+	if (bonded && client) {
+		remember_bond(client, bt_conn_get_dst(conn));
+	}
 }
 
 void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
@@ -345,25 +586,29 @@ static void stop_scan(void)
 }
 
 
-static void bt_thread(void)
+static void bt_start(void)
 {
+	int err;
 
-    k_work_init_delayable(&pairing_timeout_work, pairing_timeout);
-
-	if (dev_settings_load()) {
-		LOG_ERR("Failed to initialize settings");
-		return;
+	/*
+	 * bt_enable() initialises settings itself and settings_load() reads
+	 * them, so the storage init on the deferred-init queue must be done.
+	 */
+	if (boot_stage_wait(BOOT_SETTINGS, SETTINGS_WAIT) == -EAGAIN) {
+		LOG_WRN("Settings not initialized, enabling Bluetooth anyway");
 	}
 
-	k_sem_take(&bt_sem, K_FOREVER); // Wait for the semaphore to start Bluetooth initialization
-
-	if (bt_enable(NULL)) {
+	boot_stage_begin(BOOT_BT_ENABLE);
+	err = bt_enable(NULL);
+	boot_stage_end(BOOT_BT_ENABLE, err);
+	if (err) {
 		LOG_ERR("Failed to enable Bluetooth");
 		return;
 	}
  
 	if (IS_ENABLED(CONFIG_SETTINGS)) {
-		settings_load();
+		boot_stage_begin(BOOT_BT_LOAD);
+		boot_stage_end(BOOT_BT_LOAD, settings_load());
 	}
 
 	LOG_INF("Bluetooth initialized");
@@ -375,75 +620,194 @@ static void bt_thread(void)
 
 	bt_set_bondable(false);
 
-	start_scan();
+	connect_clients();
 	init_config_svc();
+	bt_started = true;
+	actor_post_delayed(&link_actor, FLAG_RSSI, RSSI_PERIOD);
+}
 
-	while (1) {
-        k_sem_take(&bt_sem, K_FOREVER);
-		if (atomic_test_and_clear_bit(flag, FLAG_SCAN)) {
-			if (scan_required()) {
-				start_scan();
-			} else if (is_pairing) {
-				k_work_cancel_delayable(&pairing_timeout_work);
-				atomic_set_bit(flag, FLAG_PAIRING_COMPLETE);
-				k_sem_give(&bt_sem);
-			}
-		} 
-		if (atomic_test_and_clear_bit(flag, FLAG_SLEEP_BEFORE_SCAN)) {
-			k_sleep(SCAN_DELAY);
-			atomic_set_bit(flag, FLAG_SCAN);
-			k_sem_give(&bt_sem);
+static void bt_handler(struct actor *actor, uint32_t msgs)
+{
+	if ((msgs & BIT(FLAG_START)) && !bt_started) {
+		bt_start();
+	}
+	if (msgs & BIT(FLAG_STOP)) {
+		stop_auto_connect();
+		bt_disable();
+		bt_started = false;
+	}
+	if (!bt_started) {
+		return;
+	}
+
+	if (msgs & BIT(FLAG_BOND)) {
+		/* A new bond replaces the old peer of that client in the accept list. */
+		load_bonded_addresses();
+		save_bonds();
+		msgs |= BIT(FLAG_SCAN);
+	}
+	if (msgs & BIT(FLAG_SCAN)) {
+		if (scan_required()) {
+			connect_clients();
+		} else if (is_pairing) {
+			k_work_cancel_delayable(&pairing_timeout_work);
+			actor_post(actor, FLAG_PAIRING_COMPLETE);
 		}
-		if (atomic_test_and_clear_bit(flag, FLAG_PAIR)) {
-			disconnect_all();
-			bt_set_bondable(true);
-			is_pairing = true;
-			k_work_schedule(&pairing_timeout_work, PAIRING_TIMEOUT);
-			atomic_set_bit(flag, FLAG_SLEEP_BEFORE_SCAN);
-			k_sem_give(&bt_sem);
+	} 
+	if (msgs & BIT(FLAG_PAIR)) {
+		stop_auto_connect();
+		disconnect_all();
+		bt_set_bondable(true);
+		is_pairing = true;
+		k_work_schedule(&pairing_timeout_work, PAIRING_TIMEOUT);
+		actor_post_delayed(actor, FLAG_SCAN, SCAN_DELAY);
+	}
+	if (msgs & BIT(FLAG_PAIRING_COMPLETE)) {
+		LOG_INF("Pairing completed");
+		bt_set_bondable(false);
+		is_pairing = false;
+		struct pairing_msg msg = { .complete = true };
+		channel_publish(&pairing_chan, &msg);
+		actor_post(actor, FLAG_SCAN);
+	}
+}
+
+static void link_handler(struct actor *actor, uint32_t msgs)
+{
+	int err;
+
+	if (!(msgs & BIT(FLAG_RSSI)) || !bt_started) {
+		return;
+	}
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (!clients[i]->conn) {
+			continue;
 		}
-		if (atomic_test_and_clear_bit(flag, FLAG_PAIRING_COMPLETE)) {
-			LOG_INF("Pairing completed");
-			bt_set_bondable(false);
-			is_pairing = false;
-			settings_runtime_set("event/pairing_complete", NULL, 0);
-			atomic_set_bit(flag, FLAG_SCAN);
-			k_sem_give(&bt_sem);
+		err = link_stats_sample_rssi(&clients[i]->stats, clients[i]->conn);
+		if (err) {
+			LOG_DBG("%s: RSSI read failed (err %d)", clients[i]->name, err);
 		}
 	}
+	actor_post_delayed(actor, FLAG_RSSI, RSSI_PERIOD);
 }
 
-K_THREAD_DEFINE(bt_id, STACKSIZE, bt_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
+size_t bt_link_stats_encode(uint8_t *buf, size_t size)
+{
+	size_t pos = 0;
+	size_t len;
 
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		len = link_stats_encode(clients[i]->name, &clients[i]->stats, &buf[pos], size - pos);
+		if (!len) {
+			break;
+		}
+		pos += len;
+	}
+	return pos;
+}
+
+static void settings_work_handler(struct k_work *work)
+{
+	int err;
 
+	ARG_UNUSED(work);
+
+	boot_stage_begin(BOOT_SETTINGS);
+	err = dev_settings_load();
+	if (err) {
+		LOG_ERR("Failed to initialize settings");
+	}
+	boot_stage_end(BOOT_SETTINGS, err);
+}
 
-int btsrv_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+static K_WORK_DEFINE(settings_work, settings_work_handler);
+
+static int bt_main_init(void)
 {
-	const char *next;
-	size_t name_len;
-	// int err;
+	k_work_init_delayable(&pairing_timeout_work, pairing_timeout);
+	/* The controller setup waits for the address, see bt_h4_vnd_setup(). */
+	boot_defer(&settings_work);
+	return 0;
+}
 
-	name_len = settings_name_next(name, &next);
-	if (!next) {
-		if (!strncmp(name, "start", name_len)) {
-			LOG_INF("<btsrv/start>");
-			k_sem_give(&bt_sem);
-			return 0;
+SYS_INIT(bt_main_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+
+
+static void btsrv_listener(const struct zbus_channel *chan)
+{
+	const struct btsrv_msg *msg = zbus_chan_const_msg(chan);
+
+	switch (msg->cmd) {
+	case BTSRV_START:
+		LOG_INF("<btsrv/start>");
+		actor_post(&bt_actor, FLAG_START);
+		break;
+	case BTSRV_STOP:
+		LOG_INF("<btsrv/stop>");
+		actor_post(&bt_actor, FLAG_STOP);
+		break;
+	case BTSRV_PAIR:
+		LOG_INF("<btsrv/pair>");
+		actor_post(&bt_actor, FLAG_PAIR);
+		break;
+	}
+}
+
+ZBUS_LISTENER_DEFINE(btsrv_lis, btsrv_listener);
+
+static int cmd_link_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		link_stats_print(sh, clients[i]->name, &clients[i]->stats);
+	}
+	return 0;
+}
+
+static int cmd_link_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		link_stats_reset(&clients[i]->stats);
+	}
+	shell_print(sh, "link stats cleared");
+	return 0;
+}
+
+static int cmd_link_drop(const struct shell *sh, size_t argc, char *argv[])
+{
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (strcmp(argv[1], clients[i]->name)) {
+			continue;
 		}
-		if (!strncmp(name, "stop", name_len)) {
-			LOG_INF("<btsrv/stop>");
-			bt_disable();
-			return 0;
+		if (!clients[i]->conn) {
+			shell_error(sh, "%s is not connected", clients[i]->name);
+			return -ENOTCONN;
 		}
-		if (!strncmp(name, "pair", name_len)) {
-			LOG_INF("<btsrv/pair>");
-			atomic_set_bit(flag, FLAG_PAIR);
-			k_sem_give(&bt_sem);
-			return 0;
+		/* disconnected() takes care of the rest and rescans. */
+		err = bt_conn_disconnect(clients[i]->conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		if (err) {
+			shell_error(sh, "disconnect failed (err %d)", err);
 		}
+		return err;
 	}
-	return -ENOENT;
+	shell_error(sh, "unknown client %s", argv[1]);
+	return -EINVAL;
 }
-/* static subtree handler */
-SETTINGS_STATIC_HANDLER_DEFINE(btsrv, "btsrv", NULL, btsrv_handle_set, NULL, NULL);
 
+SHELL_STATIC_SUBCMD_SET_CREATE(link_subcmd,
+	SHELL_CMD_ARG(drop, NULL, "<client>\n\nDisconnect a client to time the reconnect",
+		      cmd_link_drop, 2, 0),
+	SHELL_CMD(reset, NULL, "Clear link statistics", cmd_link_reset),
+	SHELL_CMD(show, NULL, "Notification timing, RSSI and connection history per client",
+		  cmd_link_show),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(link, &link_subcmd, "BLE link statistics", NULL);
@@ -7,6 +7,9 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 
+#include "sample_ring.h"
+#include "link_stats.h"
+
 struct gatt_client {
     char *name;
     struct bt_conn *conn;
@@ -14,26 +17,22 @@ struct gatt_client {
     const struct bt_uuid_128 *uuid;
     void (*connected_cb)();
     void (*disconnected_cb)();
+    struct link_stats stats;
+    /* Bonded peer, BT_ADDR_LE_ANY until one is stored in settings. */
+    bt_addr_le_t bond_addr;
 };
 
 extern int dev_settings_load(void);
 extern void config_svc_init(void);
+/* Link statistics records of all clients, see link_stats_encode(). */
+extern size_t bt_link_stats_encode(uint8_t *buf, size_t size);
 
 
 #ifdef CONFIG_HAS_BLE_FSR
 extern struct gatt_client fsr_srvc;
-struct fsr_data {
-    uint16_t value[4];
-};
-extern struct k_msgq fsr_msgq;
 #endif // CONFIG_HAS_BLE_FSR
 #ifdef CONFIG_HAS_BLE_CONTROLLER
 extern struct gatt_client controller_client;
-struct controller_data {
-    uint16_t value;
-    uint16_t mode;
-};
-extern struct k_msgq controller_msgq;
 #endif // CONFIG_HAS_BLE_CONTROLLER
 
 #endif // _BT_MAIN_H_
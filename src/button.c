@@ -9,7 +9,9 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/atomic.h>
 #include <zephyr/drivers/pwm.h>
-#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
+
+#include "channels.h"
 
 LOG_MODULE_REGISTER(button, LOG_LEVEL_ERR);
 
@@ -43,15 +45,22 @@ static const struct gpio_dt_spec button_1 = GPIO_DT_SPEC_GET_OR(SW1_NODE, gpios,
 
 K_SEM_DEFINE(button_sem, 0, 1);
 
+static void publish_button(enum button_event event)
+{
+    struct button_msg msg = { .event = event };
+
+    channel_publish(&button_chan, &msg);
+}
+
 static void long_work_handler(struct k_work *work)
 {
     k_mutex_lock(&input_data.lock, K_FOREVER);
     if (input_data.state == STATE_A) {
         input_data.state = STATE_NONE;
-        settings_runtime_set("event/button_a_long", NULL, 0);
+        publish_button(BUTTON_A_LONG);
     } else if (input_data.state == STATE_B) {
         input_data.state = STATE_NONE;
-        settings_runtime_set("event/button_b_long", NULL, 0);
+        publish_button(BUTTON_B_LONG);
     }
     k_mutex_unlock(&input_data.lock);
 }
@@ -69,7 +78,7 @@ void button_event(const struct device *dev, struct gpio_callback *cb, uint32_t p
             } else if (input_data.state == STATE_B) {
                 input_data.state = STATE_NONE;
                 k_work_cancel_delayable(&input_data.work);
-                settings_runtime_set("event/button_ab", NULL, 0);
+                publish_button(BUTTON_AB);
             }
             k_mutex_unlock(&input_data.lock);
         } else {
@@ -77,7 +86,7 @@ void button_event(const struct device *dev, struct gpio_callback *cb, uint32_t p
             if (input_data.state == STATE_A) {
                 input_data.state = STATE_NONE;
                 k_work_cancel_delayable(&input_data.work);
-                settings_runtime_set("event/button_a", NULL, 0);
+                publish_button(BUTTON_A);
             }
             k_mutex_unlock(&input_data.lock);
         }
@@ -93,7 +102,7 @@ void button_event(const struct device *dev, struct gpio_callback *cb, uint32_t p
             } else if (input_data.state == STATE_A) {
                 input_data.state = STATE_NONE;
                 k_work_cancel_delayable(&input_data.work);
-                settings_runtime_set("event/button_ab", NULL, 0);
+                publish_button(BUTTON_AB);
             }
             k_mutex_unlock(&input_data.lock);
         } else {
@@ -101,7 +110,7 @@ void button_event(const struct device *dev, struct gpio_callback *cb, uint32_t p
             if (input_data.state == STATE_B) {
                 input_data.state = STATE_NONE;
                 k_work_cancel_delayable(&input_data.work);
-                settings_runtime_set("event/button_b", NULL, 0);
+                publish_button(BUTTON_B);
             }
             k_mutex_unlock(&input_data.lock);
         }
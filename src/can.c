@@ -3,15 +3,22 @@
 #include <zephyr/storage/disk_access.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/can.h>
-#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
+#include <string.h>
+
+#include "channels.h"
+#include "motor_can.h"
+#include "actor.h"
+#include "sample_ring.h"
+#include "config_svc.h"
+#include "metrics.h"
+#include "latency.h"
+#include "trace.h"
 
 LOG_MODULE_REGISTER(can, LOG_LEVEL_DBG);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
-
 #define TIMER_DELAY 	K_SECONDS(5) 
-#define TIMER_INTERVAL 	K_SECONDS(5) //K_MSEC(1) 
+#define TIMER_INTERVAL 	K_MSEC(CONFIG_APP_CAN_TX_PERIOD_MS)
 
 #define TX_MSG_ID 0x100
 #define RX_MSG_ID 0x200
@@ -19,79 +26,154 @@ LOG_MODULE_REGISTER(can, LOG_LEVEL_DBG);
 /* Devicetree */
 #define CANBUS_NODE DT_CHOSEN(zephyr_canbus)
 
-K_SEM_DEFINE(tx_sem, 0, 1);
+enum can_flag {
+	FLAG_START,
+	FLAG_TX,
+	FLAG_NUM,
+};
+
+static void can_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(can_actor, actor_rt_q, can_handler, CONFIG_APP_DEADLINE_CAN_US);
 
-K_THREAD_STACK_DEFINE(rx_thread_stack, STACKSIZE);
-K_THREAD_STACK_DEFINE(tx_thread_stack, STACKSIZE);
-struct k_thread rx_thread_data, tx_thread_data;
+static can_capture_t capture;
+/* Trace of the TX period that is due, handed from the timer to the actor. */
+static atomic_t tx_trace;
 
 const struct device *const can_dev = DEVICE_DT_GET(CANBUS_NODE);
 
-CAN_MSGQ_DEFINE(rx_msgq, 5);
+METRIC_COUNTER_DEFINE(metric_can_tx, "can.tx");
+METRIC_COUNTER_DEFINE(metric_can_tx_err, "can.tx_err");
+METRIC_COUNTER_DEFINE(metric_can_tx_busy, "can.tx_busy");
+METRIC_COUNTER_DEFINE(metric_can_rx, "can.rx");
+
+static void tx_period_due(void)
+{
+    latency_handle_t trace = latency_start(LATENCY_TICK_CAN, k_cycle_get_32());
+
+    /* A period the actor has not picked up yet is superseded. */
+    latency_abort((latency_handle_t)atomic_set(&tx_trace, trace));
+    actor_post(&can_actor, FLAG_TX);
+}
 
 static void tx_timer_handler(struct k_timer *timer)
 {
-    k_sem_give(&tx_sem);
-	// LOG_DBG("TX timer expired, semaphore given");
+    /* During a capture the periods follow the replay clock instead. */
+    if (capture) {
+        return;
+    }
+    tx_period_due();
 }
 
 K_TIMER_DEFINE(tx_timer, tx_timer_handler, NULL);
 
 static void can_tx_callback(const struct device *dev, int error, void *user_data)
 {
+    latency_handle_t trace = (latency_handle_t)POINTER_TO_UINT(user_data);
+
     ARG_UNUSED(dev);
-    ARG_UNUSED(user_data);
     if (error != 0) {
         LOG_ERR("CAN TX callback error: %d", error);
+        metric_inc(&metric_can_tx_err);
+        latency_abort(trace);
     } else {
+        metric_inc(&metric_can_tx);
+        APP_TRACE("can_tx_done", trace, 0);
+        latency_stamp(trace, LATENCY_DONE);
+        latency_finish(trace);
         LOG_DBG("CAN frame sent successfully");
     }
 }
 
-static void can_tx_thread(void *unused1, void *unused2, void *unused3)
+static void can_rx_callback(const struct device *dev, struct can_frame *frame, void *user_data)
+{
+    struct sample *sample;
+    uint8_t len;
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    if (sample_live_muted()) {
+        return;
+    }
+    sample = sample_claim(SAMPLE_CAN, 0, k_cycle_get_32());
+    len = MIN(can_dlc_to_bytes(frame->dlc), sizeof(sample->can.data));
+
+    /* Only the first 8 bytes of an FD frame fit a sample slot. */
+    sample->can.id = frame->id;
+    memcpy(sample->can.data, frame->data, len);
+    sample->len = len;
+    sample_publish(sample);
+    metric_inc(&metric_can_rx);
+    APP_TRACE("can_rx", frame->id, len);
+}
+
+void can_capture_set(can_capture_t cb)
+{
+	capture = cb;
+}
+
+void can_capture_tick(void)
+{
+	tx_period_due();
+}
+
+/* Queue a frame without blocking, or hand it to the capture. */
+static int send_or_capture(const struct can_frame *frame, latency_handle_t trace)
+{
+	can_capture_t cb = capture;
+
+	if (cb) {
+		cb(frame);
+		latency_stamp(trace, LATENCY_DONE);
+		latency_finish(trace);
+		return 0;
+	}
+	return can_send(can_dev, frame, K_NO_WAIT, can_tx_callback, UINT_TO_POINTER(trace));
+}
+
+static void can_send_frame(latency_handle_t trace)
 {
-	struct can_frame frame = {
+	static uint32_t config_version;
+	struct assist_config cfg;
+	const struct can_frame frame = {
         .id = TX_MSG_ID,
         .dlc = 8,
         .flags = CAN_FRAME_IDE,
         .data = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08}};
 	int err;
 
-	k_sem_take(&tx_sem, K_FOREVER);
-    k_timer_start(&tx_timer, TIMER_DELAY, TIMER_INTERVAL);
-
-    while (true) {
-        k_sem_take(&tx_sem, K_FOREVER/*K_MSEC(2)*/);
-		LOG_DBG("Preparing to send CAN frame with ID: 0x%08x, DLC: %d",
-				frame.id, frame.dlc);
-        err = can_send(can_dev, &frame, /*K_MSEC(10)*/K_FOREVER/*K_NO_WAIT*/, can_tx_callback, NULL);
-		// LOG_DBG("CAN send returned with error: %d", err);
-        if (err != 0) {
-            LOG_ERR("failed to enqueue CAN frame (err %d)", err);
-        }
+	/* Pick up assist changes once per control period. */
+	config_snapshot(&cfg);
+	if (cfg.version != config_version) {
+		LOG_INF("Assist config v%u: flat %u, ascent %u, descent %u, manual %u",
+			cfg.version, cfg.flat_walking, cfg.stair_ascent, cfg.stair_descent,
+			cfg.manual);
+		config_version = cfg.version;
+	}
+
+	LOG_DBG("Preparing to send CAN frame with ID: 0x%08x, DLC: %d",
+			frame.id, frame.dlc);
+	/* Never block the shared queue waiting for a free TX mailbox. */
+	APP_TRACE("can_tx", frame.id, trace);
+	latency_stamp(trace, LATENCY_ENQUEUE);
+	err = send_or_capture(&frame, trace);
+	if (err != 0) {
+		LOG_ERR("failed to enqueue CAN frame (err %d)", err);
+		metric_inc(&metric_can_tx_busy);
+		latency_abort(trace);
 	}
 }
 
-static void can_rx_thread(void *unused1, void *unused2, void *unused3)
+static void can_handler(struct actor *actor, uint32_t msgs)
 {
-	const struct can_filter filter = {
-		.flags = CAN_FILTER_IDE,
-		.id = RX_MSG_ID,
-		.mask = CAN_EXT_ID_MASK
-	};
-	struct can_frame frame;
-	int filter_id;
-
-	filter_id = can_add_rx_filter_msgq(can_dev, &rx_msgq, &filter);
-	LOG_INF("Filter id: %d", filter_id);
+	if (msgs & BIT(FLAG_START)) {
+		k_timer_start(&tx_timer, TIMER_DELAY, TIMER_INTERVAL);
+	}
+	if (msgs & BIT(FLAG_TX)) {
+		latency_handle_t trace = (latency_handle_t)atomic_clear(&tx_trace);
 
-	while (true) {
-		if (!k_msgq_get(&rx_msgq, &frame, K_FOREVER)) {
-            LOG_DBG("Received CAN frame with ID: 0x%08x, DLC: %d",
-                        frame.id, frame.dlc);
-    		// LOG_HEXDUMP_DBG(frame.data, frame.dlc,
-            //             "CAN frame data");
-        }
+		latency_stamp(trace, LATENCY_CONSUME);
+		can_send_frame(trace);
 	}
 }
 
@@ -107,6 +189,12 @@ void state_change_callback(const struct device *dev, enum can_state state,
 
 static int motor_can_init(void)
 {
+	const struct can_filter filter = {
+		.flags = CAN_FILTER_IDE,
+		.id = RX_MSG_ID,
+		.mask = CAN_EXT_ID_MASK
+	};
+	int filter_id;
     int err;
     
 	LOG_DBG("");
@@ -130,17 +218,8 @@ static int motor_can_init(void)
 		return -1;
 	}
 
-	k_thread_create(&rx_thread_data, rx_thread_stack,
-				 K_THREAD_STACK_SIZEOF(rx_thread_stack),
-				 can_rx_thread, NULL, NULL, NULL,
-				 PRIORITY, 0, K_NO_WAIT);
-	k_thread_name_set(&rx_thread_data, "can_rx");
-
-	k_thread_create(&tx_thread_data, tx_thread_stack,
-				 K_THREAD_STACK_SIZEOF(tx_thread_stack),
-				 can_tx_thread, NULL, NULL, NULL,
-				 PRIORITY, 0, K_NO_WAIT);
-	k_thread_name_set(&tx_thread_data, "can_tx");
+	filter_id = can_add_rx_filter(can_dev, can_rx_callback, NULL, &filter);
+	LOG_INF("Filter id: %d", filter_id);
 
     LOG_INF("CAN controller started successfully");
 	return 0;
@@ -150,20 +229,20 @@ SYS_INIT(motor_can_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 
 
 
-int can_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+static void can_listener(const struct zbus_channel *chan)
 {
-	const char *next;
-	size_t name_len;
-
-	name_len = settings_name_next(name, &next);
-	if (!next) {
-		if (!strncmp(name, "start", name_len)) {
-			LOG_INF("<can/start>");
-			k_sem_give(&tx_sem);
-			return 0;
-		}
+	const struct can_msg *msg = zbus_chan_const_msg(chan);
+
+	switch (msg->cmd) {
+	case CAN_CMD_START:
+		LOG_INF("<can/start>");
+		actor_post(&can_actor, FLAG_START);
+		break;
+	case CAN_CMD_STOP:
+		LOG_INF("<can/stop>");
+		/* As before, the periodic TX frame keeps going once started. */
+		break;
 	}
-	return -ENOENT;
 }
-/* static subtree handler */
-SETTINGS_STATIC_HANDLER_DEFINE(can, "can", NULL, can_handle_set, NULL, NULL);
\ No newline at end of file
+
+ZBUS_LISTENER_DEFINE(can_lis, can_listener);
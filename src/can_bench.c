@@ -0,0 +1,247 @@
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample_ring.h"
+#include "metrics.h"
+
+LOG_MODULE_REGISTER(can_bench, LOG_LEVEL_INF);
+
+/*
+ * CAN loopback benchmark. Frames carry the cycle count at can_send() in
+ * their first four bytes, so the TX callback and the RX filter can time
+ * them without a lookup. Received frames go through the sample ring like
+ * any other CAN RX and are timed again when this module drains them.
+ */
+
+#define BENCH_MSG_ID 0x1ff
+#define BENCH_TX_TIMEOUT K_MSEC(100)
+#define BENCH_SETTLE K_MSEC(100)
+
+extern const struct device *const can_dev;
+
+METRIC_HISTOGRAM_DEFINE(metric_canb_tx, "can.bench.tx_us");
+METRIC_HISTOGRAM_DEFINE(metric_canb_rx, "can.bench.rx_us");
+METRIC_HISTOGRAM_DEFINE(metric_canb_consume, "can.bench.consume_us");
+
+static SAMPLE_READER_DEFINE(bench_reader);
+
+static atomic_t tx_done;
+static atomic_t tx_errors;
+static atomic_t rx_frames;
+static uint32_t consumed;
+
+static void bench_tx_callback(const struct device *dev, int error, void *user_data)
+{
+	uint32_t sent = POINTER_TO_UINT(user_data);
+
+	ARG_UNUSED(dev);
+	if (error) {
+		atomic_inc(&tx_errors);
+		return;
+	}
+	atomic_inc(&tx_done);
+	metric_observe(&metric_canb_tx, k_cyc_to_us_floor32(k_cycle_get_32() - sent));
+}
+
+static void bench_rx_callback(const struct device *dev, struct can_frame *frame, void *user_data)
+{
+	uint32_t now = k_cycle_get_32();
+	struct sample *sample;
+
+	ARG_UNUSED(dev);
+	ARG_UNUSED(user_data);
+
+	atomic_inc(&rx_frames);
+	metric_observe(&metric_canb_rx, k_cyc_to_us_floor32(now - sys_get_le32(frame->data)));
+
+	/* Same hand-off as the application RX filter in can.c. */
+	sample = sample_claim(SAMPLE_CAN, 0, now);
+	sample->can.id = frame->id;
+	memcpy(sample->can.data, frame->data, sizeof(sample->can.data));
+	sample->len = sizeof(sample->can.data);
+	sample_publish(sample);
+}
+
+static void consume_sample(const struct sample *sample, void *user_data)
+{
+	uint32_t now = *(uint32_t *)user_data;
+
+	if (sample->tag != SAMPLE_CAN || sample->can.id != BENCH_MSG_ID) {
+		return;
+	}
+	consumed++;
+	metric_observe(&metric_canb_consume, k_cyc_to_us_floor32(now - sample->cycles));
+}
+
+static void drain(void)
+{
+	uint32_t now = k_cycle_get_32();
+
+	while (sample_reader_drain(&bench_reader, consume_sample, &now, 16)) {
+		now = k_cycle_get_32();
+	}
+}
+
+static void print_hist(const struct shell *sh, const char *name, const struct metric *m)
+{
+	uint32_t n;
+
+	shell_print(sh, "%s: %u samples, p50 %u us, p99 %u us, max %u us", name,
+		    (uint32_t)atomic_get(&m->value), metric_percentile(m, 50),
+		    metric_percentile(m, 99), (uint32_t)atomic_get(&m->max));
+	for (int i = 0; i < METRIC_HIST_BUCKETS; i++) {
+		n = atomic_get(&m->buckets[i]);
+		if (n) {
+			shell_print(sh, "  %6u..%6u us: %u", metric_bucket_min(i),
+				    metric_bucket_max(i), n);
+		}
+	}
+}
+
+static int bench_run(const struct shell *sh, uint32_t rate_hz, uint8_t len, uint32_t duration_ms)
+{
+	const struct can_filter filter = {
+		.flags = 0,
+		.id = BENCH_MSG_ID,
+		.mask = CAN_STD_ID_MASK,
+	};
+	struct can_frame frame = {
+		.id = BENCH_MSG_ID,
+		.dlc = can_bytes_to_dlc(len),
+		.flags = len > CAN_MAX_DLEN ? CAN_FRAME_FDF : 0,
+	};
+	uint32_t period_us = rate_hz ? USEC_PER_SEC / rate_hz : 0;
+	uint32_t sent = 0, busy = 0;
+	uint32_t stamp, elapsed_us, done;
+	int64_t start, end, next;
+	int filter_id;
+	int err;
+
+	for (int i = 4; i < len; i++) {
+		frame.data[i] = i;
+	}
+
+	err = can_stop(can_dev);
+	if (err && err != -EALREADY) {
+		return err;
+	}
+	err = can_set_mode(can_dev, CAN_MODE_FD | CAN_MODE_LOOPBACK);
+	if (err) {
+		shell_error(sh, "loopback mode not supported (err %d)", err);
+		goto restore;
+	}
+	err = can_start(can_dev);
+	if (err) {
+		goto restore;
+	}
+	filter_id = can_add_rx_filter(can_dev, bench_rx_callback, NULL, &filter);
+	if (filter_id < 0) {
+		err = filter_id;
+		goto restore;
+	}
+
+	metric_reset(&metric_canb_tx);
+	metric_reset(&metric_canb_rx);
+	metric_reset(&metric_canb_consume);
+	atomic_clear(&tx_done);
+	atomic_clear(&tx_errors);
+	atomic_clear(&rx_frames);
+	drain();
+	consumed = 0;
+
+	start = k_uptime_ticks();
+	end = start + k_ms_to_ticks_ceil64(duration_ms);
+	next = start;
+	while (k_uptime_ticks() < end) {
+		stamp = k_cycle_get_32();
+		sys_put_le32(stamp, frame.data);
+		/* Back to back waits for a free mailbox, paced runs count it as busy. */
+		err = can_send(can_dev, &frame, period_us ? K_NO_WAIT : BENCH_TX_TIMEOUT,
+			       bench_tx_callback, UINT_TO_POINTER(stamp));
+		if (err) {
+			busy++;
+		} else {
+			sent++;
+		}
+		drain();
+		if (period_us) {
+			next += k_us_to_ticks_ceil64(period_us);
+			k_sleep(K_TIMEOUT_ABS_TICKS(next));
+		}
+	}
+	end = k_uptime_ticks();
+	k_sleep(BENCH_SETTLE);
+	drain();
+	can_remove_rx_filter(can_dev, filter_id);
+	err = 0;
+
+	elapsed_us = k_ticks_to_us_floor32(end - start);
+	done = atomic_get(&tx_done);
+
+	shell_print(sh, "%u bytes at %u Hz for %u ms: sent %u, busy %u, done %u, errors %u",
+		    len, rate_hz, duration_ms, sent, busy, done, (uint32_t)atomic_get(&tx_errors));
+	shell_print(sh, "received %u, consumed %u, %u frames/s, %u bytes/s",
+		    (uint32_t)atomic_get(&rx_frames), consumed,
+		    (uint32_t)((uint64_t)done * USEC_PER_SEC / MAX(elapsed_us, 1)),
+		    (uint32_t)((uint64_t)done * len * USEC_PER_SEC / MAX(elapsed_us, 1)));
+	print_hist(sh, "can_send to TX callback", &metric_canb_tx);
+	print_hist(sh, "can_send to RX filter", &metric_canb_rx);
+	print_hist(sh, "RX filter to consumer", &metric_canb_consume);
+
+restore:
+	can_stop(can_dev);
+	can_set_mode(can_dev, CAN_MODE_FD);
+	can_start(can_dev);
+	return err;
+}
+
+static int cmd_canbench(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t rate_hz = CONFIG_APP_CAN_BENCH_RATE_HZ;
+	uint32_t len = CONFIG_APP_CAN_BENCH_LEN;
+	uint32_t duration_ms = CONFIG_APP_CAN_BENCH_DURATION_MS;
+	int err;
+
+	if (argc > 1) {
+		rate_hz = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		len = strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		duration_ms = strtoul(argv[3], NULL, 0);
+	}
+	if (len < sizeof(uint32_t) || len > CANFD_MAX_DLEN ||
+	    can_dlc_to_bytes(can_bytes_to_dlc(len)) != len) {
+		shell_error(sh, "payload must be a CAN FD length from 4 to %u bytes", CANFD_MAX_DLEN);
+		return -EINVAL;
+	}
+	if (rate_hz > USEC_PER_SEC || duration_ms == 0) {
+		shell_error(sh, "invalid rate or duration");
+		return -EINVAL;
+	}
+	err = sample_reader_register(&bench_reader);
+	if (err) {
+		shell_error(sh, "no free sample reader (err %d)", err);
+		return err;
+	}
+
+	err = bench_run(sh, rate_hz, len, duration_ms);
+	sample_reader_unregister(&bench_reader);
+	if (err) {
+		shell_error(sh, "benchmark failed (err %d)", err);
+	}
+	return err;
+}
+
+SHELL_CMD_ARG_REGISTER(canbench, NULL,
+		       "[rate_hz [payload [duration_ms]]]\n\n"
+		       "Send frames in loopback mode and time TX, RX and the sample ring; "
+		       "rate 0 sends back to back",
+		       cmd_canbench, 1, 3);
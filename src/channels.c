@@ -0,0 +1,22 @@
+#include <zephyr/kernel.h>
+#include <zephyr/zbus/zbus.h>
+
+#include "channels.h"
+
+ZBUS_CHAN_DEFINE(button_chan, struct button_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(event_lis), ZBUS_MSG_INIT(0));
+
+ZBUS_CHAN_DEFINE(link_chan, struct link_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(event_lis), ZBUS_MSG_INIT(0));
+
+ZBUS_CHAN_DEFINE(pairing_chan, struct pairing_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(event_lis), ZBUS_MSG_INIT(0));
+
+ZBUS_CHAN_DEFINE(led_chan, struct led_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(led_lis), ZBUS_MSG_INIT(0));
+
+ZBUS_CHAN_DEFINE(btsrv_chan, struct btsrv_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(btsrv_lis), ZBUS_MSG_INIT(0));
+
+ZBUS_CHAN_DEFINE(can_chan, struct can_msg, NULL, NULL,
+		 ZBUS_OBSERVERS(can_lis), ZBUS_MSG_INIT(0));
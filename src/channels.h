@@ -0,0 +1,80 @@
+#ifndef _CHANNELS_H_
+#define _CHANNELS_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/zbus/zbus.h>
+
+/*
+ * Cross-module events. Each channel carries a fixed-size message that
+ * listeners read in place through zbus_chan_const_msg(), so a publish is a
+ * copy into the channel plus one callback per observer, no name parsing.
+ */
+
+enum button_event {
+	BUTTON_A,
+	BUTTON_B,
+	BUTTON_AB,
+	BUTTON_A_LONG,
+	BUTTON_B_LONG,
+};
+
+struct button_msg {
+	enum button_event event;
+};
+
+enum link_id {
+	LINK_FSR,
+	LINK_CONTROLLER,
+};
+
+struct link_msg {
+	enum link_id link;
+	bool connected;
+};
+
+struct pairing_msg {
+	bool complete;
+};
+
+enum led_cmd {
+	LED_POWERON,
+	LED_POWEROFF,
+	LED_STANDBY,
+	LED_READY,
+	LED_PAIRING,
+};
+
+struct led_msg {
+	enum led_cmd cmd;
+};
+
+enum btsrv_cmd {
+	BTSRV_START,
+	BTSRV_STOP,
+	BTSRV_PAIR,
+};
+
+struct btsrv_msg {
+	enum btsrv_cmd cmd;
+};
+
+enum can_cmd {
+	CAN_CMD_START,
+	CAN_CMD_STOP,
+};
+
+struct can_msg {
+	enum can_cmd cmd;
+};
+
+ZBUS_CHAN_DECLARE(button_chan, link_chan, pairing_chan, led_chan, btsrv_chan, can_chan);
+
+#define CHANNEL_PUB_TIMEOUT K_MSEC(100)
+
+/* Publish from thread or ISR context; ISRs must not block on the channel. */
+static inline int channel_publish(const struct zbus_channel *chan, const void *msg)
+{
+	return zbus_chan_pub(chan, msg, k_is_in_isr() ? K_NO_WAIT : CHANNEL_PUB_TIMEOUT);
+}
+
+#endif /* _CHANNELS_H_ */
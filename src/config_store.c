@@ -0,0 +1,127 @@
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/logging/log.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config_svc.h"
+
+LOG_MODULE_REGISTER(config_store, LOG_LEVEL_INF);
+
+#define CONFIG_FSR_DEFAULT 50
+
+struct config_field {
+	const char *key;
+	size_t offset;
+};
+
+static const struct config_field fields[ASSIST_FIELD_NUM] = {
+	[ASSIST_FIELD_FLAT_WALKING] = { "flat_walking", offsetof(struct assist_config, flat_walking) },
+	[ASSIST_FIELD_STAIR_ASCENT] = { "stair_ascent", offsetof(struct assist_config, stair_ascent) },
+	[ASSIST_FIELD_STAIR_DESCENT] = { "stair_descent", offsetof(struct assist_config, stair_descent) },
+	[ASSIST_FIELD_MANUAL] = { "manual", offsetof(struct assist_config, manual) },
+	[ASSIST_FIELD_FSR] = { "fsr", offsetof(struct assist_config, fsr) },
+};
+
+/*
+ * Two buffers, one of them current. A writer copies current into the spare,
+ * changes it and swaps the pointer. The spare's version is zeroed while it
+ * is being written, so a reader still holding it from two updates ago sees
+ * the version move and retries.
+ */
+static struct assist_config config_buf[2] = {
+	{ .version = 1, .fsr = CONFIG_FSR_DEFAULT },
+};
+static atomic_ptr_t config_current = ATOMIC_PTR_INIT(&config_buf[0]);
+static K_MUTEX_DEFINE(config_write_lock);
+
+void config_snapshot(struct assist_config *cfg)
+{
+	const struct assist_config *cur;
+	uint32_t version;
+
+	do {
+		cur = atomic_ptr_get(&config_current);
+		version = *(volatile uint32_t *)&cur->version;
+		barrier_dmem_fence_full();
+		*cfg = *cur;
+		barrier_dmem_fence_full();
+	} while (version == 0 || version != *(volatile uint32_t *)&cur->version ||
+		 cur != atomic_ptr_get(&config_current));
+}
+
+uint16_t config_field(const struct assist_config *cfg, enum assist_field id)
+{
+	return *(const uint16_t *)((const uint8_t *)cfg + fields[id].offset);
+}
+
+void config_update(enum assist_field id, uint16_t value)
+{
+	struct assist_config *cur, *next;
+	uint32_t version;
+
+	k_mutex_lock(&config_write_lock, K_FOREVER);
+	cur = atomic_ptr_get(&config_current);
+	next = (cur == &config_buf[0]) ? &config_buf[1] : &config_buf[0];
+
+	*(volatile uint32_t *)&next->version = 0;
+	barrier_dmem_fence_full();
+	memcpy((uint8_t *)next + sizeof(next->version), (uint8_t *)cur + sizeof(cur->version),
+	       sizeof(*next) - sizeof(next->version));
+	*(uint16_t *)((uint8_t *)next + fields[id].offset) = value;
+	barrier_dmem_fence_full();
+	version = cur->version + 1;
+	*(volatile uint32_t *)&next->version = version;
+	atomic_ptr_set(&config_current, next);
+	k_mutex_unlock(&config_write_lock);
+
+	LOG_DBG("config/%s = %u (v%u)", fields[id].key, value, version);
+}
+
+void config_save(uint32_t mask)
+{
+	struct assist_config cfg;
+	char key[32];
+	uint16_t value;
+	int err;
+
+	config_snapshot(&cfg);
+	for (int i = 0; i < ASSIST_FIELD_NUM; i++) {
+		if (!(mask & BIT(i))) {
+			continue;
+		}
+		snprintf(key, sizeof(key), "config/%s", fields[i].key);
+		value = config_field(&cfg, i);
+		err = settings_save_one(key, &value, sizeof(value));
+		if (err) {
+			LOG_ERR("Failed to save %s (err %d)", key, err);
+		}
+	}
+}
+
+static int config_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	size_t name_len;
+	uint16_t value;
+	int rc;
+
+	name_len = settings_name_next(name, &next);
+	if (next || len != sizeof(value)) {
+		return -EINVAL;
+	}
+	for (int i = 0; i < ASSIST_FIELD_NUM; i++) {
+		if (strlen(fields[i].key) == name_len && !strncmp(name, fields[i].key, name_len)) {
+			rc = read_cb(cb_arg, &value, sizeof(value));
+			if (rc < 0) {
+				return rc;
+			}
+			config_update(i, value);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+SETTINGS_STATIC_HANDLER_DEFINE(config, "config", NULL, config_handle_set, NULL, NULL);
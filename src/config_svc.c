@@ -9,24 +9,27 @@
 #include <zephyr/bluetooth/services/bas.h>
 
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
 
 #include <zephyr/logging/log.h>
 #include <string.h>
 #include "config_svc.h"
+#include "actor.h"
+#include "metrics.h"
+#include "bt_main.h"
 
 
 LOG_MODULE_REGISTER(config_svc, LOG_LEVEL_INF);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
-
 enum controller_flag {
 	FLAG_ADVERTISE,
+	FLAG_SAVE,
 	FLAG_NUM,
 };
-static ATOMIC_DEFINE(flag, FLAG_NUM);
 
-K_SEM_DEFINE(svc_sem, 0, 1);
+static void config_svc_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(svc_actor, actor_bg_q, config_svc_handler, 0);
 
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
@@ -52,10 +55,16 @@ static const struct bt_uuid_128 config_manual_uuid = BT_UUID_INIT_128(
     BT_UUID_128_ENCODE(0x32e950ec, 0x19c8, 0x11f0, 0x9cd2, 0x0242ac120002));	
 static const struct bt_uuid_128 config_fsr_uuid = BT_UUID_INIT_128(
     BT_UUID_128_ENCODE(0x32e95178, 0x19c8, 0x11f0, 0x9cd2, 0x0242ac120002));	
+static const struct bt_uuid_128 config_metrics_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x32e951f0, 0x19c8, 0x11f0, 0x9cd2, 0x0242ac120002));
+static const struct bt_uuid_128 config_links_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x32e95268, 0x19c8, 0x11f0, 0x9cd2, 0x0242ac120002));
 
 
 
 static struct bt_conn *svc_conn = NULL;
+/* Fields written over GATT and not saved yet, one bit per enum assist_field. */
+static atomic_t config_dirty;
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
@@ -86,8 +95,7 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 	LOG_INF("Disconnected: %s, reason 0x%02x %s", addr, reason, bt_hci_err_to_str(reason));
     svc_conn = NULL;
-    atomic_set_bit(flag, FLAG_ADVERTISE);
-    k_sem_give(&svc_sem);
+    actor_post(&svc_actor, FLAG_ADVERTISE);
 }
 
 
@@ -99,72 +107,36 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 
 void init_config_svc(void)
 {
-    atomic_set_bit(flag, FLAG_ADVERTISE);
-    k_sem_give(&svc_sem);
+    actor_post(&svc_actor, FLAG_ADVERTISE);
 }
 
-static void config_svc_thread(void)
+static void config_svc_handler(struct actor *actor, uint32_t msgs)
 {
     int err;
 
-    
-	while (1) {
-        k_sem_take(&svc_sem, K_FOREVER);
-        if (atomic_test_and_clear_bit(flag, FLAG_ADVERTISE)) {
-			err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_2, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
-			if (err) {
-				LOG_ERR("Advertising failed to start (err %d)", err);
-				return;
-			}
-			LOG_INF("Advertising started");
+    if (msgs & BIT(FLAG_SAVE)) {
+        config_save(atomic_clear(&config_dirty));
+    }
+    if (msgs & BIT(FLAG_ADVERTISE)) {
+		err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_2, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+		if (err) {
+			LOG_ERR("Advertising failed to start (err %d)", err);
+			return;
 		}
-
+		LOG_INF("Advertising started");
 	}
 }
 
-K_THREAD_DEFINE(config_svc_id, STACKSIZE, config_svc_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
-
-
-struct direct_immediate_value {
-	size_t len;
-	void *dest;
-	size_t fetched;
-};
-
-static int direct_loader(const char *name, size_t len, settings_read_cb read_cb,
-	void *cb_arg, void *param)
-{
-	struct direct_immediate_value *one_value = (struct direct_immediate_value *)param;
-    ARG_UNUSED(len);
-	const char *next;
-	size_t name_len;
-	int rc;
-
-	name_len = settings_name_next(name, &next);
-	if (name_len == 0) {
-        if (len <= one_value->len) {
-            rc = read_cb(cb_arg, one_value->dest, len);
-            if (rc >= 0) {
-                one_value->fetched = len;
-                return 0;
-            }
-            return rc;
-        }
-        return -EINVAL;
-    }
-	return 0;
-}
 
 static ssize_t read_uint16(struct bt_conn *conn, const struct bt_gatt_attr *attr,
     void *buf, uint16_t len, uint16_t offset)
 {
+    enum assist_field id = POINTER_TO_UINT(attr->user_data);
+    struct assist_config cfg;
     uint16_t value;
-    struct direct_immediate_value div = {
-        .len = sizeof(value),
-        .dest = (void *)&value,
-        .fetched = 0,
-    };
-    settings_load_subtree_direct(attr->user_data, direct_loader, &div);
+
+    config_snapshot(&cfg);
+    value = config_field(&cfg, id);
 
     return bt_gatt_attr_read(conn, attr, buf, len, offset, &value, sizeof(value));
 }
@@ -173,38 +145,75 @@ static ssize_t write_uint16(struct bt_conn *conn, const struct bt_gatt_attr *att
     const void *buf, uint16_t len, uint16_t offset,
     uint8_t flags)
 {
-    uint16_t value;
+    enum assist_field id = POINTER_TO_UINT(attr->user_data);
 
-   if (offset + len > sizeof(value)) {
+   if (offset + len > sizeof(uint16_t)) {
        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
    }
+   if (offset != 0 || len != sizeof(uint16_t)) {
+       return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+   }
 
-//    memcpy(value + offset, buf, len);
-   settings_save_one(attr->user_data, buf, len);
+   /* Takes effect immediately, the flash write happens on the background queue. */
+   config_update(id, sys_get_le16(buf));
+   atomic_or(&config_dirty, BIT(id));
+   actor_post(&svc_actor, FLAG_SAVE);
    return len;
 }
 
+static ssize_t read_metrics(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+    void *buf, uint16_t len, uint16_t offset)
+{
+    /* Long reads come in several requests, encode once so they stay consistent. */
+    static uint8_t export[CONFIG_APP_METRICS_GATT_SIZE];
+    static size_t export_len;
+
+    if (offset == 0) {
+        export_len = metrics_encode(export, sizeof(export));
+    }
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, export, export_len);
+}
+
+static ssize_t read_links(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+    void *buf, uint16_t len, uint16_t offset)
+{
+    static uint8_t export[CONFIG_APP_LINK_GATT_SIZE];
+    static size_t export_len;
+
+    if (offset == 0) {
+        export_len = bt_link_stats_encode(export, sizeof(export));
+    }
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, export, export_len);
+}
 
 BT_GATT_SERVICE_DEFINE(config_service,
 	BT_GATT_PRIMARY_SERVICE(&config_svc_uuid),
 	BT_GATT_CHARACTERISTIC(&config_flat_walking_uuid.uuid,
                 BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                 BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                read_uint16, write_uint16, "config/flat_walking"),
+                read_uint16, write_uint16, UINT_TO_POINTER(ASSIST_FIELD_FLAT_WALKING)),
 	BT_GATT_CHARACTERISTIC(&config_stair_ascent_uuid.uuid,
                 BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                 BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                read_uint16, write_uint16, "config/stair_ascent"),
+                read_uint16, write_uint16, UINT_TO_POINTER(ASSIST_FIELD_STAIR_ASCENT)),
     BT_GATT_CHARACTERISTIC(&config_stair_descent_uuid.uuid,
                 BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                 BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                read_uint16, write_uint16, "config/stair_descent"),                
+                read_uint16, write_uint16, UINT_TO_POINTER(ASSIST_FIELD_STAIR_DESCENT)),                
     BT_GATT_CHARACTERISTIC(&config_manual_uuid.uuid,
                 BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                 BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                read_uint16, write_uint16, "config/manual"),                
+                read_uint16, write_uint16, UINT_TO_POINTER(ASSIST_FIELD_MANUAL)),                
     BT_GATT_CHARACTERISTIC(&config_fsr_uuid.uuid,
                 BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                 BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                read_uint16, write_uint16, "config/fsr"),                
+                read_uint16, write_uint16, UINT_TO_POINTER(ASSIST_FIELD_FSR)),
+    BT_GATT_CHARACTERISTIC(&config_metrics_uuid.uuid,
+                BT_GATT_CHRC_READ,
+                BT_GATT_PERM_READ,
+                read_metrics, NULL, NULL),                
+    BT_GATT_CHARACTERISTIC(&config_links_uuid.uuid,
+                BT_GATT_CHRC_READ,
+                BT_GATT_PERM_READ,
+                read_links, NULL, NULL),
 );
@@ -12,11 +12,42 @@
 // 32e94f8e-19c8-11f0-9cd2-0242ac120002
 // 32e950ec-19c8-11f0-9cd2-0242ac120002
 // 32e95178-19c8-11f0-9cd2-0242ac120002
+// 32e951f0-19c8-11f0-9cd2-0242ac120002 metrics (read only, see metrics_encode())
 
 #define BT_UUID_CONFIG_SERVICE_VAL \
 	BT_UUID_128_ENCODE(0x32e94ac0, 0x19c8, 0x11f0, 0x9cd2, 0x0242ac120002)
 
 
+/*
+ * Assist configuration as seen by the sensor and motor paths. Readers take a
+ * copy with config_snapshot(), which never locks or touches flash; writers
+ * build the next version in the spare buffer and swap it in.
+ */
+struct assist_config {
+	uint32_t version;
+	uint16_t flat_walking;
+	uint16_t stair_ascent;
+	uint16_t stair_descent;
+	uint16_t manual;
+	uint16_t fsr;
+};
+
+enum assist_field {
+	ASSIST_FIELD_FLAT_WALKING,
+	ASSIST_FIELD_STAIR_ASCENT,
+	ASSIST_FIELD_STAIR_DESCENT,
+	ASSIST_FIELD_MANUAL,
+	ASSIST_FIELD_FSR,
+	ASSIST_FIELD_NUM,
+};
+
+void config_snapshot(struct assist_config *cfg);
+uint16_t config_field(const struct assist_config *cfg, enum assist_field id);
+/* Applies at once in RAM, nothing is written to flash. */
+void config_update(enum assist_field id, uint16_t value);
+/* Write the fields in mask (BIT(enum assist_field)) to settings. */
+void config_save(uint32_t mask);
+
 void init_config_svc(void);
 // typedef void (*update_callback_t)(uint16_t *val, size_t val_len);
 // void subscribed(int interval, update_callback_t callback);
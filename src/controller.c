@@ -8,7 +8,7 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/services/bas.h>
 
-#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/random/random.h>
@@ -16,12 +16,15 @@
 #include <string.h>
 #include "errno.h"
 #include "bt_main.h"
+#include "channels.h"
+#include "actor.h"
+#include "latency.h"
+#include "trace.h"
+#include "prof.h"
+#include "metrics.h"
 
 LOG_MODULE_REGISTER(controller, LOG_LEVEL_INF);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
-
 // #define VALUE_HANDLE 0x0017
 // #define VALUE_CCC_HANDLE 0x0018
 
@@ -36,14 +39,20 @@ enum state_flag {
 	FLAG_SUBSCRIBE,
 	FLAG_NUM,
 };
-static ATOMIC_DEFINE(flag, FLAG_NUM);
-K_SEM_DEFINE(cntl_sem, 0, 1);
+
+/* Give the peripheral time to settle before touching GATT after (re)connect. */
+#define GATT_SETTLE_DELAY K_MSEC(500)
+
+static void controller_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(cntl_actor, actor_bg_q, controller_handler, 0);
 
 #define CONNECTION_INTERVAL_MIN 16//16 //8
 #define CONNECTION_INTERVAL_MAX 16//16 //8
 #define CONNECTION_LATENCY      2
 #define CONNECTION_SUPERVISION_TIMEOUT 80
 
+METRIC_HISTOGRAM_DEFINE(metric_controller_interarrival, "link.controller.interarrival_us");
+
 
 // UUIDs for the controller service and notification
 // a8a618ba-16bc-11f0-9cd2-0242ac120002
@@ -97,23 +106,39 @@ static struct bt_gatt_subscribe_params subscribe_params = {
 
 
 
+PROF_SITE_DEFINE(controller_notify);
+
 static uint8_t notify_func(struct bt_conn *conn,
     struct bt_gatt_subscribe_params *params,
     const void *data, uint16_t length)
 {
+    PROF_START(controller_notify);
+
     if (!data) {
         LOG_INF("[UNSUBSCRIBED]: 0x%04x", params->value_handle);
-        atomic_set_bit(flag, FLAG_SUBSCRIBE);
-        k_sem_give(&cntl_sem);
+        actor_post_delayed(&cntl_actor, FLAG_SUBSCRIBE, GATT_SETTLE_DELAY);
         return BT_GATT_ITER_STOP;
     }
+    link_stats_notify(&controller_client.stats);
+    if (sample_live_muted()) {
+        /* A session replay owns the sample ring. */
+        PROF_END(controller_notify);
+        return BT_GATT_ITER_CONTINUE;
+    }
     if (length == sizeof(struct controller_data)) {
+        uint32_t rx = k_cycle_get_32();
+        struct sample *sample = sample_claim(SAMPLE_CONTROLLER, 0, rx);
         struct controller_data cont;
+
+        APP_TRACE("ctrl_notify", length, 0);
+
         cont.value = sys_get_be16((uint8_t*) data);
         cont.mode = sys_get_be16((uint8_t*) data + sizeof(uint16_t));
-        if (k_msgq_put(&controller_msgq, &cont, K_NO_WAIT) != 0) {
-            LOG_ERR("controller msgq full");
-        }
+        sample->controller = cont;
+        sample->len = sizeof(cont);
+        sample->trace = latency_start(LATENCY_CONTROLLER_MONITOR, rx);
+        latency_stamp(sample->trace, LATENCY_QUEUE);
+        sample_publish(sample);
         if (cont.value) {
             printf("[INDICATION]: Go mode[%d]\n", cont.mode);
         } else {
@@ -124,6 +149,7 @@ static uint8_t notify_func(struct bt_conn *conn,
     } else {
         LOG_DBG("[NOTIFICATION] data %p length %u", data, length);
     }
+    PROF_END(controller_notify);
     return BT_GATT_ITER_CONTINUE;
 }
 
@@ -144,8 +170,7 @@ static uint8_t discover_func(struct bt_conn *conn,
     if (bt_uuid_cmp(discover_params.uuid, &controller_notification_uuid.uuid) == 0) {
         LOG_INF("Service found");
         subscribe_params.value_handle = bt_gatt_attr_value_handle(attr);
-        atomic_set_bit(flag, FLAG_SUBSCRIBE);
-        k_sem_give(&cntl_sem);
+        actor_post_delayed(&cntl_actor, FLAG_SUBSCRIBE, GATT_SETTLE_DELAY);
     } 
 
     return BT_GATT_ITER_STOP;
@@ -156,27 +181,24 @@ static void connected ()
 {
     LOG_INF("Connected");
 #ifdef VALUE_HANDLE   
-    atomic_set_bit(flag, FLAG_SUBSCRIBE);
-    k_sem_give(&cntl_sem);
+    actor_post_delayed(&cntl_actor, FLAG_SUBSCRIBE, GATT_SETTLE_DELAY);
 #else
     // if (subscribe_params.value_handle) {
-    //     atomic_set_bit(flag, FLAG_SUBSCRIBE);
-    //     k_sem_give(&cntl_sem);
+    //     actor_post_delayed(&cntl_actor, FLAG_SUBSCRIBE, GATT_SETTLE_DELAY);
     // } else {
 
-        atomic_set_bit(flag, FLAG_DISCOVER);
-        k_sem_give(&cntl_sem);
+        actor_post_delayed(&cntl_actor, FLAG_DISCOVER, GATT_SETTLE_DELAY);
     // }
 #endif
-    bool val = true;
-    settings_runtime_set("event/controller_connection", &val, sizeof(val));
+    struct link_msg msg = { .link = LINK_CONTROLLER, .connected = true };
+    channel_publish(&link_chan, &msg);
 }
 
 static void disconnected () 
 {
     LOG_INF("Disconnected");
-    bool val = false;
-    settings_runtime_set("event/controller_connection", &val, sizeof(val));
+    struct link_msg msg = { .link = LINK_CONTROLLER, .connected = false };
+    channel_publish(&link_chan, &msg);
 }
 
 struct gatt_client controller_client = {
@@ -191,47 +213,40 @@ struct gatt_client controller_client = {
     .uuid = &controller_svc_uuid,
     .connected_cb = connected,
     .disconnected_cb = disconnected,
+    /* Indications only on state changes, no period. */
+    .stats = LINK_STATS_INIT(0, metric_controller_interarrival),
 };
 
 
-static void controller_thread(void)
+static void controller_handler(struct actor *actor, uint32_t msgs)
 {
     int err;
 
-	while (1) {
-        k_sem_take(&cntl_sem, K_FOREVER);
-        if (atomic_test_and_clear_bit(flag, FLAG_SUBSCRIBE)) {
-            k_sleep(K_MSEC(500));
-            if (controller_client.conn == NULL) {
-                LOG_ERR("No connection");
-                continue;
-            }
-            err = bt_gatt_subscribe(controller_client.conn, &subscribe_params);
-            if (err && err != -EALREADY) {
-                LOG_INF("Subscribe failed (err %d)", err);
-            } else {
-                LOG_INF("[SUBSCRIBED]: handle 0x%04x ccc_handle 0x%04x", 
-                    subscribe_params.value_handle, subscribe_params.ccc_handle);
-            }
-		}
+    if (msgs & BIT(FLAG_SUBSCRIBE)) {
+        if (controller_client.conn == NULL) {
+            LOG_ERR("No connection");
+            return;
+        }
+
+        err = bt_gatt_subscribe(controller_client.conn, &subscribe_params);
+        if (err && err != -EALREADY) {
+            LOG_INF("Subscribe failed (err %d)", err);
+        } else {
+            LOG_INF("[SUBSCRIBED]: handle 0x%04x ccc_handle 0x%04x", 
+                subscribe_params.value_handle, subscribe_params.ccc_handle);
+        }
+    }
 #ifndef VALUE_HANDLE   
-        else if (atomic_test_and_clear_bit(flag, FLAG_DISCOVER)) {
-            k_sleep(K_MSEC(500));
-            discover_params.uuid = &controller_notification_uuid.uuid,
-            discover_params.func = discover_func,
-            discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE,
-            discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE,
-            discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC,
-            err = bt_gatt_discover(controller_client.conn, &discover_params);
-            if (err) {
-                LOG_ERR("Discover failed (err %d)", err);
-            }
-        } 
+    if (msgs & BIT(FLAG_DISCOVER)) {
+        discover_params.uuid = &controller_notification_uuid.uuid,
+        discover_params.func = discover_func,
+        discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE,
+        discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE,
+        discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC,
+        err = bt_gatt_discover(controller_client.conn, &discover_params);
+        if (err) {
+            LOG_ERR("Discover failed (err %d)", err);
+        }
+    } 
 #endif
-
-
-	}
 }
-
-K_THREAD_DEFINE(controller_id, STACKSIZE, controller_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
-
@@ -2,50 +2,125 @@
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/sys/reboot.h>
-#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
+#include <string.h>
+
+#include "channels.h"
+#include "actor.h"
+#include "metrics.h"
+#include "latency.h"
+#include "trace.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(event, LOG_LEVEL_INF);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
-
 #define REBOOT_DELAY K_SECONDS(3)
 
-enum {
-	FLAG_ONOFF,
-	FLAG_PAIR,
-	FLAG_FSR_CONNECTIED,
-	FLAG_FSR_DISCONNECTED,
-	FLAG_CONTROLLER_CONNECTED,
-	FLAG_CONTROLLER_DISCONNECTED,
-	FLAG_PAIRING_COMPLETE,
+enum sys_event {
+	EV_ONOFF,
+	EV_PAIR,
+	EV_FSR_CONNECTED,
+	EV_FSR_DISCONNECTED,
+	EV_CONTROLLER_CONNECTED,
+	EV_CONTROLLER_DISCONNECTED,
+	EV_PAIRING_COMPLETE,
+	EV_NUM,
+};
+
+enum sys_state {
+	ST_OFF,
+	ST_STANDBY,
+	ST_READY,
+	ST_PAIRING,
+	ST_SHUTDOWN,
+	ST_NUM,
+};
+
+static const char *const event_names[EV_NUM] = {
+	[EV_ONOFF] = "onoff",
+	[EV_PAIR] = "pair",
+	[EV_FSR_CONNECTED] = "fsr_connected",
+	[EV_FSR_DISCONNECTED] = "fsr_disconnected",
+	[EV_CONTROLLER_CONNECTED] = "controller_connected",
+	[EV_CONTROLLER_DISCONNECTED] = "controller_disconnected",
+	[EV_PAIRING_COMPLETE] = "pairing_complete",
+};
+
+static const char *const state_names[ST_NUM] = {
+	[ST_OFF] = "off",
+	[ST_STANDBY] = "standby",
+	[ST_READY] = "ready",
+	[ST_PAIRING] = "pairing",
+	[ST_SHUTDOWN] = "shutdown",
+};
+
+/* One queued event, stamped with k_cycle_get_32() when it was posted. */
+struct event_entry {
+	uint8_t event;
+	latency_handle_t trace;
+	uint32_t stamp;
+};
+
+K_MSGQ_DEFINE(event_msgq, sizeof(struct event_entry), CONFIG_APP_EVENT_QUEUE_DEPTH, 4);
+
+METRIC_COUNTER_DEFINE(metric_event_overflow, "event.overflow");
+METRIC_GAUGE_DEFINE(metric_event_queue, "event.queue");
+METRIC_HISTOGRAM_DEFINE(metric_event_latency, "event.latency_us");
+
+enum event_flag {
+	FLAG_EVENT,
 	FLAG_NUM,
 };
-static ATOMIC_DEFINE(flag, FLAG_NUM);
-
-struct {
-	bool onoff;
-	bool fsr_connected;
-	bool controller_connected;
-	bool shutdown;
-	bool pairing;
-} state = {
-	.onoff = false,
-	.fsr_connected = false,
-	.controller_connected = false,
+
+static void event_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(event_actor, actor_rt_q, event_handler, CONFIG_APP_DEADLINE_EVENT_US);
+
+/* Latency from post to completed transition, per (state x event). */
+struct transition_stats {
+	uint32_t count;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
 };
 
+static struct {
+	struct transition_stats transition[ST_NUM][EV_NUM];
+	atomic_t overflow;
+	uint32_t max_batch;
+} stats;
+
+static enum sys_state state = ST_OFF;
+static uint8_t links;
+/* Trace of the event being dispatched, finished when the motor GPIO changes. */
+static latency_handle_t motor_trace;
+
 static const struct gpio_dt_spec enable_system =
 	GPIO_DT_SPEC_GET(DT_PATH(zephyr_user), enable_system_gpios);
 static const struct gpio_dt_spec enable_motor =
 	GPIO_DT_SPEC_GET(DT_PATH(zephyr_user), enable_motor_gpios);
 
-K_SEM_DEFINE(event_sem, 0, 1);
 
-struct k_work_delayable reboot_work;
+static void publish_led(enum led_cmd cmd)
+{
+	struct led_msg msg = { .cmd = cmd };
 
+	channel_publish(&led_chan, &msg);
+}
+
+static void publish_btsrv(enum btsrv_cmd cmd)
+{
+	struct btsrv_msg msg = { .cmd = cmd };
+
+	channel_publish(&btsrv_chan, &msg);
+}
+
+static void publish_can(enum can_cmd cmd)
+{
+	struct can_msg msg = { .cmd = cmd };
+
+	channel_publish(&can_chan, &msg);
+}
 
 static void reboot_handler(struct k_work *work)
 {
@@ -53,198 +128,336 @@ static void reboot_handler(struct k_work *work)
 	sys_reboot(SYS_REBOOT_COLD);
 }
 
+static K_WORK_DELAYABLE_DEFINE(reboot_work, reboot_handler);
+
+static bool links_ready(void)
+{
+	return links == (BIT(LINK_FSR) | BIT(LINK_CONTROLLER));
+}
+
+static void set_motor(int value)
+{
+	latency_stamp(motor_trace, LATENCY_ENQUEUE);
+	gpio_pin_set_dt(&enable_motor, value);
+	latency_stamp(motor_trace, LATENCY_DONE);
+	latency_finish(motor_trace);
+	motor_trace = 0;
+}
+
+/* Transition handlers return the next state. */
+typedef enum sys_state (*transition_fn)(enum sys_state from, enum sys_event ev);
 
-static void event_handler_thread(void)
+static enum sys_state power_on(enum sys_state from, enum sys_event ev)
 {
-    k_work_init_delayable(&reboot_work, reboot_handler);
+	LOG_INF("System is OFF, toggling to ON");
+	gpio_pin_set_dt(&enable_system, 1);
+	set_motor(1);
+	publish_led(LED_POWERON);
+	publish_btsrv(BTSRV_START);
+	publish_can(CAN_CMD_START);
+	return ST_STANDBY;
+}
+
+static enum sys_state power_off(enum sys_state from, enum sys_event ev)
+{
+	LOG_INF("System is ON, toggling to OFF");
+	gpio_pin_set_dt(&enable_system, 0);
+	set_motor(0);
+	publish_led(LED_POWEROFF);
+	publish_btsrv(BTSRV_STOP);
+	publish_can(CAN_CMD_STOP);
+	k_work_schedule(&reboot_work, REBOOT_DELAY);
+	return ST_SHUTDOWN;
+}
+
+static enum sys_state shutting_down(enum sys_state from, enum sys_event ev)
+{
+	LOG_INF("System is shutting down, cannot power on");
+	return from;
+}
+
+static enum sys_state reject_off(enum sys_state from, enum sys_event ev)
+{
+	LOG_ERR("Cannot handle %s while system is OFF", event_names[ev]);
+	return from;
+}
+
+static enum sys_state start_pairing(enum sys_state from, enum sys_event ev)
+{
+	LOG_INF("Pairing mode activated");
+	publish_btsrv(BTSRV_PAIR);
+	publish_led(LED_PAIRING);
+	return ST_PAIRING;
+}
+
+static enum sys_state end_pairing(enum sys_state from, enum sys_event ev)
+{
+	LOG_INF("Pairing completed");
+	if (links_ready()) {
+		publish_led(LED_READY);
+		return ST_READY;
+	}
+	publish_led(LED_STANDBY);
+	return ST_STANDBY;
+}
+
+static enum sys_state link_up(enum sys_state from, enum sys_event ev)
+{
+	if (links_ready()) {
+		publish_led(LED_READY);
+		return ST_READY;
+	}
+	return from;
+}
+
+static enum sys_state link_down(enum sys_state from, enum sys_event ev)
+{
+	publish_led(LED_STANDBY);
+	return ST_STANDBY;
+}
+
+/* NULL entries leave the state unchanged. */
+static const transition_fn transitions[ST_NUM][EV_NUM] = {
+	[ST_OFF] = {
+		[EV_ONOFF] = power_on,
+		[EV_PAIR] = reject_off,
+		[EV_PAIRING_COMPLETE] = reject_off,
+	},
+	[ST_STANDBY] = {
+		[EV_ONOFF] = power_off,
+		[EV_PAIR] = start_pairing,
+		[EV_PAIRING_COMPLETE] = end_pairing,
+		[EV_FSR_CONNECTED] = link_up,
+		[EV_FSR_DISCONNECTED] = link_down,
+		[EV_CONTROLLER_CONNECTED] = link_up,
+		[EV_CONTROLLER_DISCONNECTED] = link_down,
+	},
+	[ST_READY] = {
+		[EV_ONOFF] = power_off,
+		[EV_PAIR] = start_pairing,
+		[EV_PAIRING_COMPLETE] = end_pairing,
+		[EV_FSR_DISCONNECTED] = link_down,
+		[EV_CONTROLLER_DISCONNECTED] = link_down,
+	},
+	[ST_PAIRING] = {
+		[EV_ONOFF] = power_off,
+		[EV_PAIR] = start_pairing,
+		[EV_PAIRING_COMPLETE] = end_pairing,
+	},
+	[ST_SHUTDOWN] = {
+		[EV_ONOFF] = shutting_down,
+	},
+};
+
+static void update_links(enum sys_event ev)
+{
+	switch (ev) {
+	case EV_FSR_CONNECTED:
+		links |= BIT(LINK_FSR);
+		break;
+	case EV_FSR_DISCONNECTED:
+		links &= ~BIT(LINK_FSR);
+		break;
+	case EV_CONTROLLER_CONNECTED:
+		links |= BIT(LINK_CONTROLLER);
+		break;
+	case EV_CONTROLLER_DISCONNECTED:
+		links &= ~BIT(LINK_CONTROLLER);
+		break;
+	default:
+		break;
+	}
+}
+
+static void dispatch(const struct event_entry *entry)
+{
+	enum sys_state from = state;
+	transition_fn fn;
+	struct transition_stats *ts;
+	uint32_t latency;
+
+	if (entry->event >= EV_NUM) {
+		LOG_ERR("Unknown event %u", entry->event);
+		return;
+	}
 
+	motor_trace = entry->trace;
+	latency_stamp(motor_trace, LATENCY_CONSUME);
+	update_links(entry->event);
+	fn = transitions[from][entry->event];
+	if (fn) {
+		state = fn(from, entry->event);
+	}
+	/* The transition did not touch the motor. */
+	latency_abort(motor_trace);
+	motor_trace = 0;
+
+	latency = k_cycle_get_32() - entry->stamp;
+	metric_observe(&metric_event_latency, k_cyc_to_us_floor32(latency));
+	ts = &stats.transition[from][entry->event];
+	ts->count++;
+	ts->total_cycles += latency;
+	ts->max_cycles = MAX(ts->max_cycles, latency);
+
+	APP_TRACE("event", entry->event, (from << 8) | state);
+	LOG_INF("%s: %s -> %s", event_names[entry->event], state_names[from], state_names[state]);
+}
+
+static void event_post(enum sys_event ev)
+{
+	struct event_entry entry = {
+		.event = ev,
+		.stamp = k_cycle_get_32(),
+	};
+
+	if (ev == EV_ONOFF) {
+		entry.trace = latency_start(LATENCY_BUTTON_MOTOR, entry.stamp);
+		latency_stamp(entry.trace, LATENCY_QUEUE);
+	}
+	if (k_msgq_put(&event_msgq, &entry, K_NO_WAIT) != 0) {
+		latency_abort(entry.trace);
+		atomic_inc(&stats.overflow);
+		metric_inc(&metric_event_overflow);
+		LOG_WRN("Event queue full, dropped %s", event_names[ev]);
+		return;
+	}
+	metric_set(&metric_event_queue, k_msgq_num_used_get(&event_msgq));
+	actor_post(&event_actor, FLAG_EVENT);
+}
+
+static void event_handler(struct actor *actor, uint32_t msgs)
+{
+	struct event_entry entry;
+	uint32_t batch = 0;
+
+	ARG_UNUSED(actor);
+	ARG_UNUSED(msgs);
+
+	/* Drain everything that arrived together, in posting order. */
+	while (k_msgq_get(&event_msgq, &entry, K_NO_WAIT) == 0) {
+		dispatch(&entry);
+		batch++;
+	}
+	stats.max_batch = MAX(stats.max_batch, batch);
+}
+
+static int event_init(void)
+{
 	if (!gpio_is_ready_dt(&enable_system)) {
 		LOG_ERR("Error: device %s not ready", enable_system.port->name);
-		return;
+		return -ENODEV;
 	}
 	if (!gpio_is_ready_dt(&enable_motor)) {
 		LOG_ERR("Error: device %s not ready", enable_motor.port->name);
-		return;
+		return -ENODEV;
 	}
 	gpio_pin_configure_dt(&enable_system, GPIO_OUTPUT_LOW);
 	gpio_pin_configure_dt(&enable_motor, GPIO_OUTPUT_LOW);
+	return 0;
+}
 
-	while (1) {
-        k_sem_take(&event_sem, K_FOREVER);
-        if (atomic_test_and_clear_bit(flag, FLAG_ONOFF)) {
-			state.onoff = !state.onoff;
-            if (gpio_pin_get_dt(&enable_system)) {
-                LOG_INF("System is ON, toggling to OFF");
-                gpio_pin_set_dt(&enable_system, 0);
-                gpio_pin_set_dt(&enable_motor, 0);
-				settings_runtime_set("led/poweroff", NULL, 0);
-				settings_runtime_set("btsrv/stop", NULL, 0);
-				settings_runtime_set("can/stop", NULL, 0);
-				state.shutdown = true;
-				k_work_schedule(&reboot_work, REBOOT_DELAY);
-            } else {
-                LOG_INF("System is OFF, toggling to ON");
-				if (state.shutdown) {
-					LOG_INF("System is shutting down, cannot power on");
-					continue;
-				}
-                gpio_pin_set_dt(&enable_system, 1);
-                gpio_pin_set_dt(&enable_motor, 1);
-				settings_runtime_set("led/poweron", NULL, 0);
-				settings_runtime_set("btsrv/start", NULL, 0);
-				settings_runtime_set("can/start", NULL, 0);
-            }
-        } else if (atomic_test_and_clear_bit(flag, FLAG_PAIR)) {
-			LOG_INF("Pairing mode activated");
-			if (state.shutdown) {
-				continue;
-			}
-			state.pairing = true;
-			settings_runtime_set("btsrv/pair", NULL, 0);
-			settings_runtime_set("led/pairing", NULL, 0);
-        } else if (atomic_test_and_clear_bit(flag, FLAG_PAIRING_COMPLETE)) {
-			LOG_INF("Pairing completed");
-			if (state.shutdown) {
-				continue;
-			}
-			state.pairing = false;
-			if (state.controller_connected && state.fsr_connected) {
-				settings_runtime_set("led/ready", NULL, 0);
-			} else {
-				settings_runtime_set("led/standby", NULL, 0);
-			}
-        } else if (atomic_test_and_clear_bit(flag, FLAG_FSR_CONNECTIED)) {
-			state.fsr_connected = true;
-			LOG_INF("FSR connected");
-			if (state.shutdown) {
-				continue;
-			}
-			if (!state.pairing && state.controller_connected) {
-				settings_runtime_set("led/ready", NULL, 0);
-			}
-		} else if (atomic_test_and_clear_bit(flag, FLAG_FSR_DISCONNECTED)) {
-			state.fsr_connected = false;
-			LOG_INF("FSR disconnected");
-			if (state.shutdown) {
-				continue;
-			}
-			if (!state.pairing) {
-				settings_runtime_set("led/standby", NULL, 0);
-			}
-		} else if (atomic_test_and_clear_bit(flag, FLAG_CONTROLLER_CONNECTED)) {
-			state.controller_connected = true;
-			LOG_INF("Controller connected");
-			if (state.shutdown) {
-				continue;
-			}
-			if (!state.pairing && state.fsr_connected) {
-				settings_runtime_set("led/ready", NULL, 0);
-			}
-		} else if (atomic_test_and_clear_bit(flag, FLAG_CONTROLLER_DISCONNECTED)) {
-			state.controller_connected = false;
-			LOG_INF("Controller disconnected");
-			if (state.shutdown) {
-				continue;
-			}
-			if (!state.pairing) {
-				settings_runtime_set("led/standby", NULL, 0);
-			}
-		} else {
-			LOG_ERR("Unknown event flag");
-		}
+SYS_INIT(event_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 
+
+
+
+static void handle_button(const struct button_msg *msg)
+{
+	switch (msg->event) {
+	case BUTTON_A:
+		LOG_INF("<event/button_a>");
+		break;
+	case BUTTON_B:
+		LOG_INF("<event/button_b>");
+		break;
+	case BUTTON_AB:
+		LOG_INF("<event/button_ab>");
+		event_post(EV_ONOFF);
+		break;
+	case BUTTON_A_LONG:
+	case BUTTON_B_LONG:
+		LOG_INF("<event/button_%s_long>", msg->event == BUTTON_A_LONG ? "a" : "b");
+		event_post(EV_PAIR);
+		break;
 	}
 }
 
-K_THREAD_DEFINE(event_handler_id, STACKSIZE, event_handler_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
-
+static void handle_link(const struct link_msg *msg)
+{
+	switch (msg->link) {
+	case LINK_FSR:
+		LOG_INF("<event/fsr_connection> %s", msg->connected ? "true" : "false");
+		event_post(msg->connected ? EV_FSR_CONNECTED : EV_FSR_DISCONNECTED);
+		break;
+	case LINK_CONTROLLER:
+		LOG_INF("<event/controller_connection> %s", msg->connected ? "true" : "false");
+		event_post(msg->connected ? EV_CONTROLLER_CONNECTED : EV_CONTROLLER_DISCONNECTED);
+		break;
+	}
+}
 
+static void handle_pairing(const struct pairing_msg *msg)
+{
+	ARG_UNUSED(msg);
 
+	LOG_INF("<event/pairing_complete>");
+	event_post(EV_PAIRING_COMPLETE);
+}
 
-int event_handle_get(const char *name, char *val, int val_len_max)
+static void event_listener(const struct zbus_channel *chan)
 {
-	return -ENOENT;
+	if (chan == &button_chan) {
+		handle_button(zbus_chan_const_msg(chan));
+	} else if (chan == &link_chan) {
+		handle_link(zbus_chan_const_msg(chan));
+	} else if (chan == &pairing_chan) {
+		handle_pairing(zbus_chan_const_msg(chan));
+	}
 }
 
-int event_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+ZBUS_LISTENER_DEFINE(event_lis, event_listener);
+
+
+static int cmd_events_stats(const struct shell *sh, size_t argc, char *argv[])
 {
-	const char *next;
-	size_t name_len;
-	// int err;
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
 
-	name_len = settings_name_next(name, &next);
-	if (!next) {
-		if (!strncmp(name, "button_a", name_len)) {
-			LOG_INF("<event/button_a>");
-			return 0;
-		}
-		if (!strncmp(name, "button_b", name_len)) {
-			LOG_INF("<event/button_b>");
-			return 0;
-		}
-		if (!strncmp(name, "button_ab", name_len)) {
-			LOG_INF("<event/button_ab>");
-            atomic_set_bit(flag, FLAG_ONOFF);
-            k_sem_give(&event_sem);
-			return 0;
-		}
-		if (!strncmp(name, "button_a_long", name_len)) {
-			LOG_INF("<event/button_a_long>");
-			if (!state.onoff) {
-				LOG_ERR("Cannot pair while system is OFF");
-				return -EPERM;
-			}
-			atomic_set_bit(flag, FLAG_PAIR);
-            k_sem_give(&event_sem);
-			return 0;
-		}
-		if (!strncmp(name, "button_b_long", name_len)) {
-			LOG_INF("<event/button_b_long>");
-			if (!state.onoff) {
-				LOG_ERR("Cannot pair while system is OFF");
-				return -EPERM;
-			}
-			atomic_set_bit(flag, FLAG_PAIR);
-            k_sem_give(&event_sem);
-			return 0;
-		}
-		if (!strncmp(name, "fsr_connection", name_len)) {
-			bool val;
-			read_cb(cb_arg, &val, sizeof(val));
-			LOG_INF("<event/fsr_connection> %s", val ? "true" : "false");
-			if (val) {
-				atomic_set_bit(flag, FLAG_FSR_CONNECTIED);
-			} else {
-				atomic_set_bit(flag, FLAG_FSR_DISCONNECTED);
+	shell_print(sh, "state %s, queued %u/%u, overflow %ld, max batch %u",
+		    state_names[state], k_msgq_num_used_get(&event_msgq),
+		    CONFIG_APP_EVENT_QUEUE_DEPTH, atomic_get(&stats.overflow), stats.max_batch);
+	shell_print(sh, "%-10s %-24s %8s %10s %10s", "state", "event", "count", "avg us", "max us");
+	for (int s = 0; s < ST_NUM; s++) {
+		for (int e = 0; e < EV_NUM; e++) {
+			const struct transition_stats *ts = &stats.transition[s][e];
+
+			if (ts->count == 0) {
+				continue;
 			}
-			k_sem_give(&event_sem);
-			return 0;
-		}
-		if (!strncmp(name, "controller_connection", name_len)) {
-			bool val;
-			read_cb(cb_arg, &val, sizeof(val));
-			LOG_INF("<event/controller_connection> %s", val ? "true" : "false");
-			if (val) {
-				atomic_set_bit(flag, FLAG_CONTROLLER_CONNECTED);
-			} else {
-				atomic_set_bit(flag, FLAG_CONTROLLER_DISCONNECTED);
-			}	
-			k_sem_give(&event_sem);
-			return 0;
+			shell_print(sh, "%-10s %-24s %8u %10u %10u", state_names[s], event_names[e],
+				    ts->count,
+				    (uint32_t)k_cyc_to_us_floor64(ts->total_cycles / ts->count),
+				    k_cyc_to_us_floor32(ts->max_cycles));
 		}
-		if (!strncmp(name, "pairing_complete", name_len)) {
-			LOG_INF("<event/pairing_complete>");
-			if (!state.onoff) {
-				LOG_ERR("Cannot complete pairing while system is OFF");
-				return -EPERM;
-			}
-			atomic_set_bit(flag, FLAG_PAIRING_COMPLETE);
-			k_sem_give(&event_sem);
-			return 0;
-		}		
 	}
-	return -ENOENT;
+	return 0;
+}
+
+static int cmd_events_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	memset(stats.transition, 0, sizeof(stats.transition));
+	atomic_clear(&stats.overflow);
+	stats.max_batch = 0;
+	shell_print(sh, "event statistics cleared");
+	return 0;
 }
-/* static subtree handler */
-SETTINGS_STATIC_HANDLER_DEFINE(event, "event", event_handle_get, event_handle_set, NULL, NULL);
 
+SHELL_STATIC_SUBCMD_SET_CREATE(events_subcmd,
+	SHELL_CMD_ARG(reset, NULL, "Clear transition statistics", cmd_events_reset, 1, 0),
+	SHELL_CMD_ARG(stats, NULL, "Show state, queue and transition latency", cmd_events_stats, 1, 0),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(events, &events_subcmd, "System event state machine", NULL);
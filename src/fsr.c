@@ -8,13 +8,18 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/services/bas.h>
 
-#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 
 #include <zephyr/random/random.h>
 #include <string.h>
 #include "bt_main.h"
+#include "channels.h"
+#include "latency.h"
+#include "trace.h"
+#include "prof.h"
+#include "metrics.h"
 
 LOG_MODULE_REGISTER(fsr, LOG_LEVEL_DBG);
 
@@ -22,6 +27,10 @@ LOG_MODULE_REGISTER(fsr, LOG_LEVEL_DBG);
 #define CONNECTION_INTERVAL_MAX 8
 #define CONNECTION_LATENCY 0
 #define CONNECTION_SUPERVISION_TIMEOUT 48
+/* The sensor notifies once per connection interval. */
+#define NOTIFY_PERIOD_MS 10
+
+METRIC_HISTOGRAM_DEFINE(metric_fsr_interarrival, "link.fsr.interarrival_us");
 
 static const struct bt_uuid_128 fsr_svc_uuid = BT_UUID_INIT_128(
 	BT_UUID_128_ENCODE(0xe2505f48, 0x01a0, 0x11f0, 0x9cd2, 0x0242ac120002));	
@@ -54,32 +63,46 @@ static struct bt_gatt_subscribe_params subscribe_params = {
     .notify = notify_func,
 };
 
+PROF_SITE_DEFINE(fsr_notify);
+
 static uint8_t notify_func(struct bt_conn *conn,
     struct bt_gatt_subscribe_params *params,
     const void *data, uint16_t length)
 {
+    PROF_START(fsr_notify);
+
     if (!data) {
         LOG_INF("[UNSUBSCRIBED]: 0x%04x", params->value_handle);
         return BT_GATT_ITER_STOP;
     }
+    link_stats_notify(&fsr_srvc.stats);
+    if (sample_live_muted()) {
+        /* A session replay owns the sample ring. */
+        PROF_END(fsr_notify);
+        return BT_GATT_ITER_CONTINUE;
+    }
     if (length == 8) {
-        struct fsr_data fsr;
-        fsr.value[0] = sys_get_be16(data);
-        fsr.value[1] = sys_get_be16((uint8_t*) data + 2);
-        fsr.value[2] = sys_get_be16((uint8_t*) data + 4);
-        fsr.value[3] = sys_get_be16((uint8_t*) data + 6); // Not used, but can be set to 0 or any other value
-        if (k_msgq_put(&fsr_msgq, &fsr, K_NO_WAIT) != 0) {
-            LOG_ERR("FSR msgq full");
-        }
-        if (fsr.value[0] > 50 || fsr.value[1] > 50 || fsr.value[2] > 50 || fsr.value[3] > 50) {
-            LOG_DBG("[FSR Pressed]: %u %u %u %u", fsr.value[0], fsr.value[1], fsr.value[2], fsr.value[3]);
-        }
+        uint32_t rx = k_cycle_get_32();
+        struct sample *sample = sample_claim(SAMPLE_FSR, 0, rx);
+        struct fsr_data *fsr = &sample->fsr;
+
+        APP_TRACE("fsr_notify", length, 0);
+
+        fsr->value[0] = sys_get_be16(data);
+        fsr->value[1] = sys_get_be16((uint8_t*) data + 2);
+        fsr->value[2] = sys_get_be16((uint8_t*) data + 4);
+        fsr->value[3] = sys_get_be16((uint8_t*) data + 6); // Not used, but can be set to 0 or any other value
+        sample->len = sizeof(*fsr);
+        sample->trace = latency_start(LATENCY_FSR_MONITOR, rx);
+        latency_stamp(sample->trace, LATENCY_QUEUE);
+        sample_publish(sample);
 
         // LOG_DBG("[NOTIFICATION] %u %u %u %u", sys_get_be16(data), sys_get_be16((uint8_t*) data + 2), 
         //                             sys_get_be16((uint8_t*) data + 4), sys_get_be16((uint8_t*) data + 6));
     } else {
         LOG_DBG("[NOTIFICATION] data %p length %u", data, length);
     }
+    PROF_END(fsr_notify);
     return BT_GATT_ITER_CONTINUE;
 }
 
@@ -116,8 +139,8 @@ static void connected ()
     int err;
 
     LOG_INF("Connected");
-    bool val = true;
-    settings_runtime_set("event/fsr_connection", &val, sizeof(val));
+    struct link_msg msg = { .link = LINK_FSR, .connected = true };
+    channel_publish(&link_chan, &msg);
 	if (subscribe_params.value_handle) {
 		err = bt_gatt_subscribe(fsr_srvc.conn, &subscribe_params);
 		if (err && err != -EALREADY) {
@@ -136,8 +159,8 @@ static void connected ()
 static void disconnected () 
 {
     LOG_INF("Disconnected");
-    bool val = false;
-    settings_runtime_set("event/fsr_connection", &val, sizeof(val));
+    struct link_msg msg = { .link = LINK_FSR, .connected = false };
+    channel_publish(&link_chan, &msg);
     // fsr_conn = NULL;
 }
 
@@ -153,5 +176,6 @@ struct gatt_client fsr_srvc = {
     .uuid = &fsr_svc_uuid,
     .connected_cb = connected,
     .disconnected_cb = disconnected,
+    .stats = LINK_STATS_INIT(NOTIFY_PERIOD_MS, metric_fsr_interarrival),
 };
 
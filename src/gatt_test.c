@@ -0,0 +1,427 @@
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+LOG_MODULE_REGISTER(gatt_test, LOG_LEVEL_INF);
+
+/*
+ * GATT throughput test service for a phone or PC on the peripheral link.
+ *
+ * stream  notify             u32 sequence number + filler, size and rate set
+ *                            by the control characteristic or the shell
+ * sink    write without rsp  floods; a leading u32 sequence number is checked
+ *                            for gaps
+ * ping    notify + write     every CONFIG_APP_GATT_TEST_PING_MS during a
+ *                            stream the board notifies u32 sequence + u32
+ *                            cycles, the peer writes the 8 bytes back and the
+ *                            round trip goes into gatt_test.rtt_us
+ * control write              u8 op: 0 stop, 1 start (u16 size, u16 rate_hz,
+ *                            u32 duration_ms follow), 2 reset statistics
+ * stats   read               see gatt_test_encode()
+ *
+ * Notifications that find no free buffer are counted as stalls, and the
+ * time spent waiting for a buffer is added up.
+ */
+
+#define GATT_TEST_UUID(_w32) \
+	BT_UUID_128_ENCODE(_w32, 0x19c8, 0x11f0, 0x9cd2, 0x0242ac120002)
+
+static const struct bt_uuid_128 test_svc_uuid = BT_UUID_INIT_128(GATT_TEST_UUID(0x32e952e0));
+static const struct bt_uuid_128 test_stream_uuid = BT_UUID_INIT_128(GATT_TEST_UUID(0x32e95358));
+static const struct bt_uuid_128 test_sink_uuid = BT_UUID_INIT_128(GATT_TEST_UUID(0x32e953d0));
+static const struct bt_uuid_128 test_ping_uuid = BT_UUID_INIT_128(GATT_TEST_UUID(0x32e95448));
+static const struct bt_uuid_128 test_control_uuid = BT_UUID_INIT_128(GATT_TEST_UUID(0x32e954c0));
+static const struct bt_uuid_128 test_stats_uuid = BT_UUID_INIT_128(GATT_TEST_UUID(0x32e95538));
+
+#define PING_LEN 8
+#define STALL_BACKOFF K_MSEC(1)
+#define STATS_LEN (14 * 4)
+
+enum control_op {
+	OP_STOP,
+	OP_START,
+	OP_RESET,
+};
+
+METRIC_HISTOGRAM_DEFINE(metric_gatt_rtt, "gatt_test.rtt_us");
+
+static struct {
+	bool active;
+	bool stream_notify;
+	bool ping_notify;
+	uint16_t size;
+	uint16_t rate_hz;
+	uint32_t duration_ms;
+	uint32_t seq;
+	uint32_t ping_seq;
+} stream;
+
+static struct {
+	uint32_t queued;
+	atomic_t sent;
+	atomic_t sent_bytes;
+	uint32_t stalls;
+	uint32_t stall_us;
+	uint32_t errors;
+	uint32_t elapsed_ms;
+
+	uint32_t writes;
+	uint32_t bytes;
+	uint32_t gaps;
+	uint32_t next_seq;
+	int64_t first_rx;
+	int64_t last_rx;
+} stats;
+
+static K_SEM_DEFINE(stream_start, 0, 1);
+static uint8_t stream_buf[CONFIG_APP_GATT_TEST_MAX_SIZE];
+
+static void stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	metric_reset(&metric_gatt_rtt);
+}
+
+static int start_stream(uint16_t size, uint16_t rate_hz, uint32_t duration_ms)
+{
+	if (size < sizeof(uint32_t) || size > CONFIG_APP_GATT_TEST_MAX_SIZE || !duration_ms) {
+		return -EINVAL;
+	}
+	if (!stream.stream_notify) {
+		return -ENOTCONN;
+	}
+	if (stream.active) {
+		return -EBUSY;
+	}
+	stream.size = size;
+	stream.rate_hz = rate_hz;
+	stream.duration_ms = duration_ms;
+	stream.active = true;
+	k_sem_give(&stream_start);
+	return 0;
+}
+
+static void stream_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	stream.stream_notify = value == BT_GATT_CCC_NOTIFY;
+	if (!stream.stream_notify) {
+		stream.active = false;
+	}
+}
+
+static void ping_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	stream.ping_notify = value == BT_GATT_CCC_NOTIFY;
+}
+
+static ssize_t write_sink(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			  uint16_t len, uint16_t offset, uint8_t flags)
+{
+	int64_t now = k_uptime_get();
+	uint32_t seq;
+
+	if (!stats.writes) {
+		stats.first_rx = now;
+	}
+	stats.last_rx = now;
+	stats.writes++;
+	stats.bytes += len;
+	if (len >= sizeof(seq)) {
+		seq = sys_get_le32(buf);
+		if (stats.writes > 1 && seq != stats.next_seq) {
+			stats.gaps++;
+		}
+		stats.next_seq = seq + 1;
+	}
+	return len;
+}
+
+static ssize_t write_ping(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			  uint16_t len, uint16_t offset, uint8_t flags)
+{
+	uint32_t sent;
+
+	if (len != PING_LEN) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+	sent = sys_get_le32((const uint8_t *)buf + 4);
+	metric_observe(&metric_gatt_rtt, k_cyc_to_us_floor32(k_cycle_get_32() - sent));
+	return len;
+}
+
+static ssize_t write_control(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const uint8_t *p = buf;
+	int err = 0;
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (len < 1) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+	switch (p[0]) {
+	case OP_STOP:
+		stream.active = false;
+		break;
+	case OP_START:
+		if (len != 9) {
+			return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+		}
+		err = start_stream(sys_get_le16(&p[1]), sys_get_le16(&p[3]), sys_get_le32(&p[5]));
+		break;
+	case OP_RESET:
+		stats_reset();
+		break;
+	default:
+		return BT_GATT_ERR(BT_ATT_ERR_NOT_SUPPORTED);
+	}
+	return err ? BT_GATT_ERR(BT_ATT_ERR_UNLIKELY) : len;
+}
+
+static uint32_t per_sec(uint32_t n, uint32_t ms)
+{
+	return ms ? (uint32_t)((uint64_t)n * MSEC_PER_SEC / ms) : 0;
+}
+
+static uint32_t rx_ms(void)
+{
+	return (uint32_t)(stats.last_rx - stats.first_rx);
+}
+
+/*
+ * Little endian u32 each: notifications queued and sent, bytes sent, stalls,
+ * stall ms, errors, stream bytes/s, writes received, bytes received, sequence
+ * gaps, received bytes/s, round trip samples, p50 and p99 us.
+ */
+static size_t gatt_test_encode(uint8_t *buf)
+{
+	uint32_t values[] = {
+		stats.queued,
+		atomic_get(&stats.sent),
+		atomic_get(&stats.sent_bytes),
+		stats.stalls,
+		stats.stall_us / USEC_PER_MSEC,
+		stats.errors,
+		per_sec(atomic_get(&stats.sent_bytes), stats.elapsed_ms),
+		stats.writes,
+		stats.bytes,
+		stats.gaps,
+		per_sec(stats.bytes, rx_ms()),
+		atomic_get(&metric_gatt_rtt.value),
+		metric_percentile(&metric_gatt_rtt, 50),
+		metric_percentile(&metric_gatt_rtt, 99),
+	};
+
+	BUILD_ASSERT(sizeof(values) == STATS_LEN);
+	for (int i = 0; i < ARRAY_SIZE(values); i++) {
+		sys_put_le32(values[i], &buf[4 * i]);
+	}
+	return STATS_LEN;
+}
+
+static ssize_t read_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+			  uint16_t len, uint16_t offset)
+{
+	static uint8_t export[STATS_LEN];
+
+	if (offset == 0) {
+		gatt_test_encode(export);
+	}
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, export, sizeof(export));
+}
+
+BT_GATT_SERVICE_DEFINE(gatt_test_service,
+	BT_GATT_PRIMARY_SERVICE(&test_svc_uuid),
+	BT_GATT_CHARACTERISTIC(&test_stream_uuid.uuid, BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE,
+			       NULL, NULL, NULL),
+	BT_GATT_CCC(stream_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&test_sink_uuid.uuid, BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, write_sink, NULL),
+	BT_GATT_CHARACTERISTIC(&test_ping_uuid.uuid,
+			       BT_GATT_CHRC_NOTIFY | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, write_ping, NULL),
+	BT_GATT_CCC(ping_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&test_control_uuid.uuid, BT_GATT_CHRC_WRITE, BT_GATT_PERM_WRITE,
+			       NULL, write_control, NULL),
+	BT_GATT_CHARACTERISTIC(&test_stats_uuid.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ,
+			       read_stats, NULL, NULL),
+);
+
+/* Attribute indexes of the characteristic values in gatt_test_service. */
+#define STREAM_ATTR (&gatt_test_service.attrs[2])
+#define PING_ATTR (&gatt_test_service.attrs[7])
+
+static void notify_sent(struct bt_conn *conn, void *user_data)
+{
+	atomic_inc(&stats.sent);
+	atomic_add(&stats.sent_bytes, POINTER_TO_UINT(user_data));
+}
+
+static void send_ping(void)
+{
+	uint8_t ping[PING_LEN];
+
+	sys_put_le32(stream.ping_seq++, ping);
+	sys_put_le32(k_cycle_get_32(), &ping[4]);
+	bt_gatt_notify(NULL, PING_ATTR, ping, sizeof(ping));
+}
+
+/* Queue one notification, backing off while the stack has no buffer. */
+static int notify_stream(void)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = STREAM_ATTR,
+		.data = stream_buf,
+		.len = stream.size,
+		.func = notify_sent,
+		.user_data = UINT_TO_POINTER(stream.size),
+	};
+	uint32_t t;
+	int err;
+
+	sys_put_le32(stream.seq, stream_buf);
+	while (stream.active) {
+		err = bt_gatt_notify_cb(NULL, &params);
+		if (err != -ENOMEM) {
+			return err;
+		}
+		stats.stalls++;
+		t = k_cycle_get_32();
+		k_sleep(STALL_BACKOFF);
+		stats.stall_us += k_cyc_to_us_floor32(k_cycle_get_32() - t);
+	}
+	return -ECANCELED;
+}
+
+static void stream_run(void *p1, void *p2, void *p3)
+{
+	int64_t start, end, next, next_ping;
+	int64_t ping_ticks = k_ms_to_ticks_ceil64(CONFIG_APP_GATT_TEST_PING_MS);
+	int err;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (size_t i = 0; i < sizeof(stream_buf); i++) {
+		stream_buf[i] = (uint8_t)i;
+	}
+
+	while (1) {
+		k_sem_take(&stream_start, K_FOREVER);
+		LOG_INF("Streaming %u byte notifications at %u Hz for %u ms", stream.size,
+			stream.rate_hz, stream.duration_ms);
+
+		start = k_uptime_ticks();
+		end = start + k_ms_to_ticks_ceil64(stream.duration_ms);
+		next = start;
+		next_ping = start;
+		while (stream.active && k_uptime_ticks() < end) {
+			if (stream.ping_notify && k_uptime_ticks() >= next_ping) {
+				send_ping();
+				next_ping += ping_ticks;
+			}
+			err = notify_stream();
+			if (err == -ECANCELED) {
+				break;
+			}
+			if (err) {
+				stats.errors++;
+				LOG_WRN("Notification failed (err %d)", err);
+				break;
+			}
+			stats.queued++;
+			stream.seq++;
+			if (stream.rate_hz) {
+				next += k_us_to_ticks_ceil64(USEC_PER_SEC / stream.rate_hz);
+				k_sleep(K_TIMEOUT_ABS_TICKS(next));
+			}
+		}
+		stats.elapsed_ms += k_ticks_to_ms_floor32(k_uptime_ticks() - start);
+		stream.active = false;
+		LOG_INF("Stream done: %u sent, %u bytes/s, %u stalls", (uint32_t)atomic_get(&stats.sent),
+			per_sec(atomic_get(&stats.sent_bytes), stats.elapsed_ms), stats.stalls);
+	}
+}
+
+K_THREAD_DEFINE(gatt_test_thread, CONFIG_APP_GATT_TEST_STACK_SIZE, stream_run, NULL, NULL, NULL,
+		CONFIG_APP_GATT_TEST_PRIORITY, 0, 0);
+
+static int cmd_gatttest_start(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t size = argc > 1 ? strtoul(argv[1], NULL, 0) : CONFIG_APP_GATT_TEST_SIZE;
+	uint32_t rate = argc > 2 ? strtoul(argv[2], NULL, 0) : CONFIG_APP_GATT_TEST_RATE_HZ;
+	uint32_t duration = argc > 3 ? strtoul(argv[3], NULL, 0) : CONFIG_APP_GATT_TEST_DURATION_MS;
+	int err;
+
+	err = start_stream(MIN(size, UINT16_MAX), MIN(rate, UINT16_MAX), duration);
+	if (err == -ENOTCONN) {
+		shell_error(sh, "no peer subscribed to the stream characteristic");
+	} else if (err) {
+		shell_error(sh, "cannot start stream (err %d)", err);
+	}
+	return err;
+}
+
+static int cmd_gatttest_stop(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	stream.active = false;
+	return 0;
+}
+
+static int cmd_gatttest_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "stream: %s, %u bytes at %u Hz", stream.active ? "running" : "idle",
+		    stream.size, stream.rate_hz);
+	shell_print(sh, "  queued %u, sent %u, %u bytes/s over %u ms", stats.queued,
+		    (uint32_t)atomic_get(&stats.sent),
+		    per_sec(atomic_get(&stats.sent_bytes), stats.elapsed_ms), stats.elapsed_ms);
+	shell_print(sh, "  stalls %u (%u ms waiting for buffers), errors %u", stats.stalls,
+		    stats.stall_us / USEC_PER_MSEC, stats.errors);
+	shell_print(sh, "sink: %u writes, %u bytes, %u bytes/s, %u sequence gaps", stats.writes,
+		    stats.bytes, per_sec(stats.bytes, rx_ms()), stats.gaps);
+	shell_print(sh, "round trip: %u samples, p50 %u us, p99 %u us, max %u us",
+		    (uint32_t)atomic_get(&metric_gatt_rtt.value),
+		    metric_percentile(&metric_gatt_rtt, 50), metric_percentile(&metric_gatt_rtt, 99),
+		    (uint32_t)atomic_get(&metric_gatt_rtt.max));
+	return 0;
+}
+
+static int cmd_gatttest_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	stats_reset();
+	shell_print(sh, "gatt test stats cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(gatttest_subcmd,
+	SHELL_CMD(reset, NULL, "Clear statistics", cmd_gatttest_reset),
+	SHELL_CMD(show, NULL, "Stream, sink and round trip statistics", cmd_gatttest_show),
+	SHELL_CMD_ARG(start, NULL,
+		      "[size [rate_hz [duration_ms]]]\n\n"
+		      "Stream notifications to the subscribed peer, rate 0 as fast as possible",
+		      cmd_gatttest_start, 1, 3),
+	SHELL_CMD(stop, NULL, "Stop streaming", cmd_gatttest_stop),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(gatttest, &gatttest_subcmd, "GATT throughput test service", NULL);
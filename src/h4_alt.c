@@ -14,13 +14,16 @@
 
 #include <zephyr/init.h>
 #include <zephyr/drivers/uart.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/sys/byteorder.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/hci.h>
 #include <zephyr/drivers/bluetooth.h>
+#include <zephyr/bluetooth/hci_types.h>
 
 #define LOG_LEVEL 3
 #include <zephyr/logging/log.h>
@@ -29,9 +32,41 @@ LOG_MODULE_REGISTER(bt_driver);
 #include "common/bt_str.h"
 
 #include "util.h"
+#include "tcm.h"
+#include "metrics.h"
+#include "trace.h"
+#include "prof.h"
 
 #define DT_DRV_COMPAT zephyr_bt_hci_uart
 
+METRIC_COUNTER_DEFINE(metric_hci_evt_discard, "hci.evt_discard");
+METRIC_COUNTER_DEFINE(metric_hci_rx_defer, "hci.rx_defer");
+
+PROF_SITE_DEFINE(bt_uart_isr);
+PROF_SITE_DEFINE(read_payload);
+PROF_SITE_DEFINE(process_tx);
+
+/* Transport counters, written from the ISR and the RX thread only. */
+struct h4_stats {
+	struct {
+		uint32_t bytes;		/* H:4 packets delivered, type byte included */
+		uint32_t packets;
+		uint32_t discard_bytes;	/* read and dropped */
+		uint32_t evt_discard;	/* discardable events dropped for lack of buffers */
+		uint32_t alloc_fail;	/* no buffer in the ISR, deferred to rx_thread */
+		uint32_t no_space;	/* packet larger than the buffer */
+		uint32_t disable;	/* RX interrupt disabled waiting for a buffer */
+		uint32_t stall_cycles;	/* total time RX stayed disabled for that */
+		uint32_t stall_start;	/* when the current stall began */
+		bool stalled;		/* RX is disabled waiting for a buffer */
+	} rx;
+	struct {
+		uint32_t bytes;
+		uint32_t packets;
+		uint32_t errors;
+	} tx;
+};
+
 struct h4_data {
 	struct {
 		struct net_buf *buf;
@@ -61,6 +96,8 @@ struct h4_data {
 	} tx;
 
 	bt_hci_recv_t recv;
+
+	struct h4_stats stats;
 };
 
 struct h4_config {
@@ -70,7 +107,7 @@ struct h4_config {
 	struct k_thread *rx_thread;
 };
 
-static inline void h4_get_type(const struct device *dev)
+static __app_itcm inline void h4_get_type(const struct device *dev)
 {
 	const struct h4_config *cfg = dev->config;
 	struct h4_data *h4 = dev->data;
@@ -104,7 +141,7 @@ static inline void h4_get_type(const struct device *dev)
 	}
 }
 
-static void h4_read_hdr(const struct device *dev)
+static __app_itcm void h4_read_hdr(const struct device *dev)
 {
 	const struct h4_config *cfg = dev->config;
 	struct h4_data *h4 = dev->data;
@@ -119,7 +156,7 @@ static void h4_read_hdr(const struct device *dev)
 	}
 }
 
-static inline void get_acl_hdr(const struct device *dev)
+static __app_itcm inline void get_acl_hdr(const struct device *dev)
 {
 	struct h4_data *h4 = dev->data;
 
@@ -134,7 +171,7 @@ static inline void get_acl_hdr(const struct device *dev)
 	}
 }
 
-static inline void get_iso_hdr(const struct device *dev)
+static __app_itcm inline void get_iso_hdr(const struct device *dev)
 {
 	struct h4_data *h4 = dev->data;
 
@@ -149,7 +186,7 @@ static inline void get_iso_hdr(const struct device *dev)
 	}
 }
 
-static inline void get_evt_hdr(const struct device *dev)
+static __app_itcm inline void get_evt_hdr(const struct device *dev)
 {
 	struct h4_data *h4 = dev->data;
 
@@ -186,12 +223,12 @@ static inline void get_evt_hdr(const struct device *dev)
 }
 
 
-static inline void copy_hdr(struct h4_data *h4)
+static __app_itcm inline void copy_hdr(struct h4_data *h4)
 {
 	net_buf_add_mem(h4->rx.buf, h4->rx.hdr, h4->rx.hdr_len);
 }
 
-static void reset_rx(struct h4_data *h4)
+static __app_itcm void reset_rx(struct h4_data *h4)
 {
 	h4->rx.type = BT_HCI_H4_NONE;
 	h4->rx.remaining = 0U;
@@ -200,7 +237,7 @@ static void reset_rx(struct h4_data *h4)
 	h4->rx.discardable = false;
 }
 
-static struct net_buf *get_rx(struct h4_data *h4, k_timeout_t timeout)
+static __app_itcm struct net_buf *get_rx(struct h4_data *h4, k_timeout_t timeout)
 {
 	LOG_DBG("type 0x%02x, evt 0x%02x", h4->rx.type, h4->rx.evt.evt);
 
@@ -240,8 +277,14 @@ static void rx_thread(void *p1, void *p2, void *p3)
 		if (h4->rx.have_hdr && !h4->rx.buf) {
 			h4->rx.buf = get_rx(h4, K_FOREVER);
 			LOG_DBG("Got rx.buf %p", h4->rx.buf);
+			if (h4->stats.rx.stalled) {
+				h4->stats.rx.stall_cycles +=
+					k_cycle_get_32() - h4->stats.rx.stall_start;
+				h4->stats.rx.stalled = false;
+			}
 			if (h4->rx.remaining > net_buf_tailroom(h4->rx.buf)) {
 				LOG_ERR("Not enough space in buffer");
+				h4->stats.rx.no_space++;
 				h4->rx.discard = h4->rx.remaining;
 				reset_rx(h4);
 			} else {
@@ -271,7 +314,7 @@ static void rx_thread(void *p1, void *p2, void *p3)
 	}
 }
 
-static size_t h4_discard(const struct device *uart, size_t len)
+static __app_itcm size_t h4_discard(const struct device *uart, size_t len)
 {
 	uint8_t buf[33];
 	int err;
@@ -285,7 +328,7 @@ static size_t h4_discard(const struct device *uart, size_t len)
 	return err;
 }
 
-static inline void read_payload(const struct device *dev)
+static __app_itcm inline void read_payload(const struct device *dev)
 {
 	const struct h4_config *cfg = dev->config;
 	struct h4_data *h4 = dev->data;
@@ -299,12 +342,19 @@ static inline void read_payload(const struct device *dev)
 		if (!h4->rx.buf) {
 			if (h4->rx.discardable) {
 				LOG_WRN("Discarding event 0x%02x", h4->rx.evt.evt);
+				metric_inc(&metric_hci_evt_discard);
+				h4->stats.rx.evt_discard++;
 				h4->rx.discard = h4->rx.remaining;
 				reset_rx(h4);
 				return;
 			}
 
 			LOG_WRN("Failed to allocate, deferring to rx_thread");
+			metric_inc(&metric_hci_rx_defer);
+			h4->stats.rx.alloc_fail++;
+			h4->stats.rx.disable++;
+			h4->stats.rx.stall_start = k_cycle_get_32();
+			h4->stats.rx.stalled = true;
 			uart_irq_rx_disable(cfg->uart);
 			return;
 		}
@@ -315,6 +365,7 @@ static inline void read_payload(const struct device *dev)
 		if (buf_tailroom < h4->rx.remaining) {
 			LOG_ERR("Not enough space in buffer %u/%zu", h4->rx.remaining,
 				buf_tailroom);
+			h4->stats.rx.no_space++;
 			h4->rx.discard = h4->rx.remaining;
 			reset_rx(h4);
 			return;
@@ -351,11 +402,14 @@ static inline void read_payload(const struct device *dev)
 
 	reset_rx(h4);
 
+	h4->stats.rx.packets++;
+	h4->stats.rx.bytes += buf->len + 1;
+	APP_TRACE("h4_rx", buf->len, bt_buf_get_type(buf));
 	LOG_DBG("Putting buf %p to rx fifo", buf);
 	k_fifo_put(&h4->rx.fifo, buf);
 }
 
-static inline void read_header(const struct device *dev)
+static __app_itcm inline void read_header(const struct device *dev)
 {
 	struct h4_data *h4 = dev->data;
 
@@ -383,6 +437,7 @@ static inline void read_header(const struct device *dev)
 	if (h4->rx.have_hdr && h4->rx.buf) {
 		if (h4->rx.remaining > net_buf_tailroom(h4->rx.buf)) {
 			LOG_ERR("Not enough space in buffer");
+			h4->stats.rx.no_space++;
 			h4->rx.discard = h4->rx.remaining;
 			reset_rx(h4);
 		} else {
@@ -391,7 +446,7 @@ static inline void read_header(const struct device *dev)
 	}
 }
 
-static inline void process_tx(const struct device *dev)
+static __app_itcm inline void process_tx(const struct device *dev)
 {
 	const struct h4_config *cfg = dev->config;
 	struct h4_data *h4 = dev->data;
@@ -422,6 +477,7 @@ static inline void process_tx(const struct device *dev)
 			__fallthrough;
 		default:
 			LOG_ERR("Unknown buffer type");
+			h4->stats.tx.errors++;
 			goto done;
 		}
 
@@ -431,19 +487,24 @@ static inline void process_tx(const struct device *dev)
 			h4->tx.type = BT_HCI_H4_NONE;
 			return;
 		}
+		h4->stats.tx.bytes++;
 	}
 
 	bytes = uart_fifo_fill(cfg->uart, h4->tx.buf->data, h4->tx.buf->len);
 	if (unlikely(bytes < 0)) {
 		LOG_ERR("Unable to write to UART (err %d)", bytes);
+		h4->stats.tx.errors++;
 	} else {
 		net_buf_pull(h4->tx.buf, bytes);
+		h4->stats.tx.bytes += bytes;
 	}
 
 	if (h4->tx.buf->len) {
 		return;
 	}
 
+	h4->stats.tx.packets++;
+
 done:
 	h4->tx.type = BT_HCI_H4_NONE;
 	net_buf_unref(h4->tx.buf);
@@ -453,7 +514,7 @@ done:
 	}
 }
 
-static inline void process_rx(const struct device *dev)
+static __app_itcm inline void process_rx(const struct device *dev)
 {
 	const struct h4_config *cfg = dev->config;
 	struct h4_data *h4 = dev->data;
@@ -463,30 +524,40 @@ static inline void process_rx(const struct device *dev)
 		h4->rx.buf ? h4->rx.buf->len : 0);
 
 	if (h4->rx.discard) {
-		h4->rx.discard -= h4_discard(cfg->uart, h4->rx.discard);
+		size_t len = h4_discard(cfg->uart, h4->rx.discard);
+
+		h4->rx.discard -= len;
+		h4->stats.rx.discard_bytes += len;
 		return;
 	}
 
 	if (h4->rx.have_hdr) {
+		PROF_START(read_payload);
 		read_payload(dev);
+		PROF_END(read_payload);
 	} else {
 		read_header(dev);
 	}
 }
 
-static void bt_uart_isr(const struct device *uart, void *user_data)
+static __app_itcm void bt_uart_isr(const struct device *uart, void *user_data)
 {
 	struct device *dev = user_data;
+	PROF_START(bt_uart_isr);
 
+	APP_TRACE("h4_isr", 0, 0);
 	while (uart_irq_update(uart) && uart_irq_is_pending(uart)) {
 		if (uart_irq_tx_ready(uart)) {
+			PROF_START(process_tx);
 			process_tx(dev);
+			PROF_END(process_tx);
 		}
 
 		if (uart_irq_rx_ready(uart)) {
 			process_rx(dev);
 		}
 	}
+	PROF_END(bt_uart_isr);
 }
 
 static int h4_send(const struct device *dev, struct net_buf *buf)
@@ -607,7 +678,7 @@ static DEVICE_API(bt_hci, h4_driver_api) = {
 		.rx_thread_stack_size = K_KERNEL_STACK_SIZEOF(rx_thread_stack_##inst), \
 		.rx_thread = &rx_thread_##inst, \
 	}; \
-	static struct h4_data h4_data_##inst = { \
+	static struct h4_data h4_data_##inst __app_dtcm_data = { \
 		.rx = { \
 			.fifo = Z_FIFO_INITIALIZER(h4_data_##inst.rx.fifo), \
 		}, \
@@ -619,3 +690,149 @@ static DEVICE_API(bt_hci, h4_driver_api) = {
 			      POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &h4_driver_api)
 
 DT_INST_FOREACH_STATUS_OKAY(BT_UART_DEVICE_INIT)
+
+/* HCI commands used by the throughput test, both carry a 248 byte name. */
+#ifndef BT_HCI_OP_READ_LOCAL_NAME
+#define BT_HCI_OP_READ_LOCAL_NAME BT_OP(BT_OGF_BASEBAND, 0x0014)
+#endif
+#define HCI_LOCAL_NAME_LEN 248
+#define HCI_THROUGHPUT_COUNT 200
+
+static struct h4_data *h4_dev_data(void)
+{
+	const struct device *dev = DEVICE_DT_GET(DT_DRV_INST(0));
+
+	return dev->data;
+}
+
+/* The ISR updates the counters, take them in one piece. */
+static void stats_snapshot(struct h4_data *h4, struct h4_stats *st)
+{
+	unsigned int key = irq_lock();
+
+	*st = h4->stats;
+	irq_unlock(key);
+}
+
+static void print_stats(const struct shell *sh, const struct h4_stats *st)
+{
+	shell_print(sh, "rx: %u packets, %u bytes, %u bytes discarded", st->rx.packets,
+		    st->rx.bytes, st->rx.discard_bytes);
+	shell_print(sh, "    %u events discarded, %u allocation failures, %u too large",
+		    st->rx.evt_discard, st->rx.alloc_fail, st->rx.no_space);
+	shell_print(sh, "    RX disabled %u times for %u us", st->rx.disable,
+		    k_cyc_to_us_floor32(st->rx.stall_cycles));
+	shell_print(sh, "tx: %u packets, %u bytes, %u errors", st->tx.packets, st->tx.bytes,
+		    st->tx.errors);
+}
+
+static int cmd_hci_stats(const struct shell *sh, size_t argc, char *argv[])
+{
+	struct h4_stats st;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	stats_snapshot(h4_dev_data(), &st);
+	print_stats(sh, &st);
+	return 0;
+}
+
+static int cmd_hci_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	struct h4_data *h4 = h4_dev_data();
+	unsigned int key;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	key = irq_lock();
+	memset(&h4->stats, 0, sizeof(h4->stats));
+	irq_unlock(key);
+	shell_print(sh, "hci stats cleared");
+	return 0;
+}
+
+static uint32_t per_second(uint32_t value, uint64_t us)
+{
+	return us ? (uint32_t)((uint64_t)value * USEC_PER_SEC / us) : 0;
+}
+
+/*
+ * Read Local Name returns 248 bytes and Write Local Name sends them back
+ * unchanged, so each round moves a full-size command and event over the
+ * UART without changing controller state.
+ */
+static int cmd_hci_throughput(const struct shell *sh, size_t argc, char *argv[])
+{
+	struct h4_data *h4 = h4_dev_data();
+	uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : HCI_THROUGHPUT_COUNT;
+	uint8_t name[HCI_LOCAL_NAME_LEN];
+	struct h4_stats before, after;
+	struct net_buf *buf, *rsp;
+	uint64_t start, us;
+	uint32_t rounds;
+	int err = 0;
+
+	if (!bt_is_ready()) {
+		shell_error(sh, "Bluetooth not enabled");
+		return -ENODEV;
+	}
+
+	stats_snapshot(h4, &before);
+	start = k_ticks_to_us_floor64(k_uptime_ticks());
+	for (rounds = 0; rounds < count; rounds++) {
+		err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_LOCAL_NAME, NULL, &rsp);
+		if (err) {
+			break;
+		}
+		if (rsp->len < 1 + sizeof(name)) {
+			net_buf_unref(rsp);
+			err = -EMSGSIZE;
+			break;
+		}
+		memcpy(name, rsp->data + 1, sizeof(name));
+		net_buf_unref(rsp);
+
+		buf = bt_hci_cmd_create(BT_HCI_OP_WRITE_LOCAL_NAME, sizeof(name));
+		if (!buf) {
+			err = -ENOBUFS;
+			break;
+		}
+		net_buf_add_mem(buf, name, sizeof(name));
+		err = bt_hci_cmd_send_sync(BT_HCI_OP_WRITE_LOCAL_NAME, buf, NULL);
+		if (err) {
+			break;
+		}
+	}
+	us = k_ticks_to_us_floor64(k_uptime_ticks()) - start;
+	stats_snapshot(h4, &after);
+
+	if (err) {
+		shell_warn(sh, "stopped after %u rounds (err %d)", rounds, err);
+	}
+	after.rx.packets -= before.rx.packets;
+	after.rx.bytes -= before.rx.bytes;
+	after.tx.packets -= before.tx.packets;
+	after.tx.bytes -= before.tx.bytes;
+	shell_print(sh, "%u rounds in %u us, %u us per command", rounds, (uint32_t)us,
+		    rounds ? (uint32_t)(us / (2 * rounds)) : 0);
+	shell_print(sh, "tx: %u packets/s, %u bytes/s", per_second(after.tx.packets, us),
+		    per_second(after.tx.bytes, us));
+	shell_print(sh, "rx: %u packets/s, %u bytes/s", per_second(after.rx.packets, us),
+		    per_second(after.rx.bytes, us));
+	if (after.rx.evt_discard != before.rx.evt_discard ||
+	    after.rx.disable != before.rx.disable || after.tx.errors != before.tx.errors) {
+		shell_warn(sh, "transport dropped or stalled during the test, see 'hci stats'");
+	}
+	return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hci_subcmd,
+	SHELL_CMD(reset, NULL, "Clear transport counters", cmd_hci_reset),
+	SHELL_CMD(stats, NULL, "H:4 transport counters per direction", cmd_hci_stats),
+	SHELL_CMD_ARG(throughput, NULL, "[rounds]\n\nTime full-size commands over the transport",
+		      cmd_hci_throughput, 1, 1),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(hci, &hci_subcmd, "HCI transport commands", NULL);
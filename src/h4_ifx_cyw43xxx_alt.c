@@ -26,6 +26,8 @@
  
  #include <stdint.h>
  
+ #include "boot.h"
+ 
  #define DT_DRV_COMPAT infineon_cyw43xxx_bt_hci
  
  BUILD_ASSERT(DT_PROP(DT_INST_GPARENT(0), hw_flow_control) == 1,
@@ -38,6 +40,9 @@
  /* Stabilization delay after FW loading */
  #define BT_STABILIZATION_DELAY_MS         (250u)
  
+ /* Longest wait for the device address from settings */
+ #define BT_SETTINGS_WAIT                  K_SECONDS(5)
+ 
  /* HCI Command packet from Host to Controller */
  #define HCI_COMMAND_PACKET                (0x01)
  
@@ -259,6 +264,7 @@
 		 return -EINVAL;
 	 }
  
+	 boot_stage_begin(BOOT_BT_POWER);
  #if DT_INST_NODE_HAS_PROP(0, bt_reg_on_gpios)
 	 struct gpio_dt_spec bt_reg_on = GPIO_DT_SPEC_GET(DT_DRV_INST(0), bt_reg_on_gpios);
  
@@ -291,20 +297,24 @@
  
 	 /* Send HCI_RESET */
 	 err = bt_hci_cmd_send_sync(BT_HCI_OP_RESET, NULL, NULL);
+	 boot_stage_end(BOOT_BT_POWER, err);
 	 if (err) {
 		 return err;
 	 }
  
+	 boot_stage_begin(BOOT_BT_FIRMWARE);
 	 /* Re-configure baudrate for BT Controller */
 	 if (fw_download_speed != default_uart_speed) {
 		 err = bt_update_controller_baudrate(dev, fw_download_speed);
 		 if (err) {
+			 boot_stage_end(BOOT_BT_FIRMWARE, err);
 			 return err;
 		 }
 	 }
  
 	 /* BT firmware download */
 	 err = bt_firmware_download(brcm_patchram_buf, (uint32_t) brcm_patch_ram_length);
+	 boot_stage_end(BOOT_BT_FIRMWARE, err);
 	 if (err) {
 		 return err;
 	 }
@@ -326,6 +336,10 @@
 		 return err;
 	 }
  
+	 /* The address comes from settings, loaded on the deferred-init queue meanwhile. */
+	 if (boot_stage_wait(BOOT_SETTINGS, BT_SETTINGS_WAIT) == -EAGAIN) {
+		 LOG_WRN("Settings not loaded, using the current address");
+	 }
 	 err = bt_update_local_dev_addr(dev);
 	 if (err) {
 	 	return err;
@@ -0,0 +1,295 @@
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CONFIG_UART_EMUL
+#include <zephyr/drivers/serial/uart_emul.h>
+#endif
+
+#include "uart_imu.h"
+
+LOG_MODULE_REGISTER(imu_replay, LOG_LEVEL_INF);
+
+/*
+ * Replays a captured IMU byte stream into one IMU input, which the replay
+ * owns meanwhile. With the UART emulator the bytes enter through the
+ * emulated FIFO and the real ISR; on the target they are injected behind
+ * the ISR with uart_imu_inject(). The capture is loaded into RAM
+ * once and looped for the duration of a run.
+ */
+
+#define IMU_FRAME_SYNC CONFIG_APP_IMU_FRAME_SYNC
+#define IMU_FRAME_LEN CONFIG_APP_IMU_FRAME_LEN
+#define REPLAY_TICK_MS 1
+/* Bytes handed over per step when running as fast as possible. */
+#define REPLAY_CHUNK 64
+#define REPLAY_SETTLE K_MSEC(50)
+#define SWEEP_MAX_SPEED 1024
+
+/* 8N1: ten bit times per byte at 1x. */
+#define LINE_RATE_BPS(node) (DT_PROP(node, current_speed) / 10)
+
+static const struct device *const imu_uarts[] = {
+	DEVICE_DT_GET(DT_ALIAS(imu0)),
+	DEVICE_DT_GET(DT_ALIAS(imu1)),
+};
+
+static const uint32_t line_rate[] = {
+	LINE_RATE_BPS(DT_ALIAS(imu0)),
+	LINE_RATE_BPS(DT_ALIAS(imu1)),
+};
+
+static uint8_t capture[CONFIG_APP_IMU_REPLAY_BUF_SIZE];
+static size_t capture_len;
+
+struct replay_result {
+	uint32_t fed;
+	uint32_t dropped;
+	uint32_t frames;
+	uint32_t bad_checksum;
+	uint32_t resync;
+	uint32_t overflows;
+	uint32_t errors;
+	uint32_t elapsed_us;
+};
+
+static int load_capture(const struct shell *sh, const char *path)
+{
+	struct fs_file_t file;
+	ssize_t ret;
+	uint8_t sum;
+
+	if (strcmp(path, "-") == 0) {
+		/* Generated stream of valid frames, same shape as the sim feeder. */
+		capture_len = sizeof(capture) - sizeof(capture) % IMU_FRAME_LEN;
+		for (size_t n = 0; n < capture_len / IMU_FRAME_LEN; n++) {
+			uint8_t *frame = &capture[n * IMU_FRAME_LEN];
+
+			frame[0] = IMU_FRAME_SYNC;
+			frame[1] = 0x51 + n % 3;
+			sum = frame[0] + frame[1];
+			for (int i = 2; i < IMU_FRAME_LEN - 1; i++) {
+				frame[i] = (uint8_t)(n * (i + 1));
+				sum += frame[i];
+			}
+			frame[IMU_FRAME_LEN - 1] = sum;
+		}
+		return 0;
+	}
+
+	fs_file_t_init(&file);
+	ret = fs_open(&file, path, FS_O_READ);
+	if (ret) {
+		shell_error(sh, "cannot open %s (err %d)", path, (int)ret);
+		return ret;
+	}
+	ret = fs_read(&file, capture, sizeof(capture));
+	fs_close(&file);
+	if (ret <= 0) {
+		shell_error(sh, "cannot read %s (err %d)", path, (int)ret);
+		return ret ? ret : -ENODATA;
+	}
+	capture_len = ret;
+	if (capture_len == sizeof(capture)) {
+		shell_warn(sh, "capture truncated to %zu bytes", capture_len);
+	}
+	return 0;
+}
+
+static uint32_t feed(uint8_t index, const uint8_t *data, uint32_t len)
+{
+#ifdef CONFIG_UART_EMUL
+	return uart_emul_put_rx_data(imu_uarts[index], data, len);
+#else
+	int ret = uart_imu_inject(index, data, len);
+
+	return ret < 0 ? 0 : ret;
+#endif
+}
+
+/* Hand over len bytes of the looped capture starting at *pos. */
+static void feed_bytes(uint8_t index, size_t *pos, uint32_t len, struct replay_result *res)
+{
+	uint32_t n, put;
+
+	while (len) {
+		n = MIN(len, capture_len - *pos);
+		put = feed(index, &capture[*pos], n);
+		res->fed += n;
+		res->dropped += n - put;
+		*pos = (*pos + n) % capture_len;
+		len -= n;
+	}
+}
+
+/* speed is a multiple of the UART line rate, 0 feeds as fast as possible. */
+static int replay(uint8_t index, uint32_t speed, uint32_t duration_ms,
+		  struct replay_result *res)
+{
+	uint32_t rate = line_rate[index] * speed;
+	struct uart_imu_stats before, after;
+	uint32_t dropped;
+	uint64_t due;
+	size_t pos = 0;
+	int64_t start, end, next;
+	int err;
+
+	memset(res, 0, sizeof(*res));
+	err = IS_ENABLED(CONFIG_UART_EMUL) ? uart_imu_own(index) : uart_imu_inject_begin(index);
+	if (err) {
+		return err;
+	}
+
+	uart_imu_stats_get(index, &before);
+	start = k_uptime_ticks();
+	end = start + k_ms_to_ticks_ceil64(duration_ms);
+	next = start;
+	while (k_uptime_ticks() < end) {
+		if (speed) {
+			/* Everything the line has sent by the next step, so a late wakeup catches up. */
+			next += k_ms_to_ticks_ceil64(REPLAY_TICK_MS);
+			due = (uint64_t)rate * k_ticks_to_us_floor64(next - start) / USEC_PER_SEC;
+			feed_bytes(index, &pos, (uint32_t)(due - res->fed), res);
+			k_sleep(K_TIMEOUT_ABS_TICKS(next));
+			continue;
+		}
+		dropped = res->dropped;
+		feed_bytes(index, &pos, REPLAY_CHUNK, res);
+		/*
+		 * The IMU actor preempts this thread as soon as bytes are posted.
+		 * Back off a tick once the input is full; on native_sim that is
+		 * also what lets simulated time advance.
+		 */
+		if (res->dropped != dropped || IS_ENABLED(CONFIG_ARCH_POSIX)) {
+			k_sleep(K_TICKS(1));
+		} else {
+			k_yield();
+		}
+	}
+	res->elapsed_us = k_ticks_to_us_floor32(k_uptime_ticks() - start);
+	k_sleep(REPLAY_SETTLE);
+
+	uart_imu_inject_end(index);
+	uart_imu_stats_get(index, &after);
+	res->frames = after.frames - before.frames;
+	res->bad_checksum = after.bad_checksum - before.bad_checksum;
+	res->resync = after.resync - before.resync;
+	res->overflows = after.overflows - before.overflows;
+	res->errors = after.errors - before.errors;
+	return 0;
+}
+
+static uint32_t per_sec(uint32_t n, uint32_t us)
+{
+	return (uint32_t)((uint64_t)n * USEC_PER_SEC / MAX(us, 1));
+}
+
+static void print_result(const struct shell *sh, const struct replay_result *res)
+{
+	uint32_t processed = res->fed - res->dropped;
+
+	shell_print(sh, "  fed %u bytes, dropped %u, processed %u bytes/s", res->fed,
+		    res->dropped, per_sec(processed, res->elapsed_us));
+	shell_print(sh, "  frames %u (%u/s), bad checksum %u, resync %u, overflows %u, errors %u",
+		    res->frames, per_sec(res->frames, res->elapsed_us), res->bad_checksum,
+		    res->resync, res->overflows, res->errors);
+}
+
+static int parse_imu(const struct shell *sh, const char *arg, uint8_t *index)
+{
+	*index = strtoul(arg, NULL, 0);
+	if (*index >= ARRAY_SIZE(imu_uarts)) {
+		shell_error(sh, "no imu %u", *index);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int cmd_replay_run(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t speed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+	uint32_t duration_ms = argc > 4 ? strtoul(argv[4], NULL, 0) :
+					  CONFIG_APP_IMU_REPLAY_DURATION_MS;
+	struct replay_result res;
+	uint8_t index = 0;
+	int err;
+
+	if (argc > 3 && parse_imu(sh, argv[3], &index)) {
+		return -EINVAL;
+	}
+	err = load_capture(sh, argv[1]);
+	if (err) {
+		return err;
+	}
+
+	err = replay(index, speed, duration_ms, &res);
+	if (err) {
+		shell_error(sh, "imu%u is busy (err %d)", index, err);
+		return err;
+	}
+	if (speed) {
+		shell_print(sh, "imu%u: %zu bytes at %ux (%u bytes/s) for %u ms", index,
+			    capture_len, speed, line_rate[index] * speed, duration_ms);
+	} else {
+		shell_print(sh, "imu%u: %zu bytes as fast as possible for %u ms", index,
+			    capture_len, duration_ms);
+	}
+	print_result(sh, &res);
+	return 0;
+}
+
+static int cmd_replay_sweep(const struct shell *sh, size_t argc, char *argv[])
+{
+	struct replay_result res;
+	uint32_t sustained = 0;
+	uint8_t index = 0;
+	int err;
+
+	if (argc > 2 && parse_imu(sh, argv[2], &index)) {
+		return -EINVAL;
+	}
+	err = load_capture(sh, argv[1]);
+	if (err) {
+		return err;
+	}
+
+	for (uint32_t speed = 1; speed <= SWEEP_MAX_SPEED; speed *= 2) {
+		err = replay(index, speed, CONFIG_APP_IMU_REPLAY_STEP_MS, &res);
+		if (err) {
+			shell_error(sh, "imu%u is busy (err %d)", index, err);
+			return err;
+		}
+		shell_print(sh, "%ux (%u bytes/s):", speed, line_rate[index] * speed);
+		print_result(sh, &res);
+		if (res.overflows || res.dropped) {
+			break;
+		}
+		sustained = speed;
+	}
+	if (sustained) {
+		shell_print(sh, "imu%u sustains %ux line rate, %u bytes/s", index, sustained,
+			    line_rate[index] * sustained);
+	} else {
+		shell_print(sh, "imu%u overflows at 1x line rate", index);
+	}
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(replay_subcmd,
+	SHELL_CMD_ARG(run, NULL,
+		      "<file|-> [speed] [imu] [duration_ms]\n\n"
+		      "Replay a capture at a multiple of the line rate, 0 for as fast as "
+		      "possible; - replays generated frames",
+		      cmd_replay_run, 2, 3),
+	SHELL_CMD_ARG(sweep, NULL,
+		      "<file|-> [imu]\n\nDouble the replay rate until the input overflows",
+		      cmd_replay_sweep, 2, 1),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(imureplay, &replay_subcmd, "Replay IMU UART captures", NULL);
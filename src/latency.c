@@ -0,0 +1,229 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#include <stdio.h>
+
+#include "latency.h"
+#include "metrics.h"
+
+LOG_MODULE_REGISTER(latency, LOG_LEVEL_INF);
+
+#define TRACES		CONFIG_APP_LATENCY_TRACES
+#define SLOT_BITS	3
+#define SLOT_MASK	BIT_MASK(SLOT_BITS)
+/* Handles are (generation << SLOT_BITS | slot) with generations 1..GEN_MAX. */
+#define GEN_MAX		BIT_MASK(8 - SLOT_BITS)
+/* A trace not finished within this time is reclaimed, its data was dropped. */
+#define STALE_CYCLES	(sys_clock_hw_cycles_per_sec() / 10)
+
+BUILD_ASSERT(TRACES <= BIT(SLOT_BITS), "too many latency trace slots");
+
+struct latency_trace {
+	uint8_t path;
+	uint8_t gen;
+	uint8_t stamped;
+	uint32_t stamp[LATENCY_STAGE_NUM];
+};
+
+static struct latency_trace traces[TRACES];
+static atomic_t busy;
+
+static const char *const path_names[] = {
+	[LATENCY_FSR_MONITOR] = "fsr->monitor",
+	[LATENCY_CONTROLLER_MONITOR] = "controller->monitor",
+	[LATENCY_TICK_CAN] = "tick->can",
+	[LATENCY_BUTTON_MOTOR] = "button->motor",
+};
+
+static const char *const stage_names[] = {
+	[LATENCY_RX] = "rx",
+	[LATENCY_QUEUE] = "queue",
+	[LATENCY_CONSUME] = "consume",
+	[LATENCY_ENQUEUE] = "enqueue",
+	[LATENCY_DONE] = "done",
+};
+
+/* End-to-end totals are registered metrics, the per-stage splits are not. */
+METRIC_HISTOGRAM_DEFINE(metric_latency_fsr_monitor, "latency.fsr_monitor_us");
+METRIC_HISTOGRAM_DEFINE(metric_latency_controller_monitor, "latency.controller_monitor_us");
+METRIC_HISTOGRAM_DEFINE(metric_latency_tick_can, "latency.tick_can_us");
+METRIC_HISTOGRAM_DEFINE(metric_latency_button_motor, "latency.button_motor_us");
+METRIC_COUNTER_DEFINE(metric_latency_untraced, "latency.untraced");
+METRIC_COUNTER_DEFINE(metric_latency_stale, "latency.stale");
+
+static struct metric *const totals[LATENCY_PATH_NUM] = {
+	[LATENCY_FSR_MONITOR] = &metric_latency_fsr_monitor,
+	[LATENCY_CONTROLLER_MONITOR] = &metric_latency_controller_monitor,
+	[LATENCY_TICK_CAN] = &metric_latency_tick_can,
+	[LATENCY_BUTTON_MOTOR] = &metric_latency_button_motor,
+};
+
+static atomic_t stage_buckets[LATENCY_PATH_NUM][LATENCY_STAGE_NUM - 1][METRIC_HIST_BUCKETS];
+static struct metric stages[LATENCY_PATH_NUM][LATENCY_STAGE_NUM - 1];
+
+static struct latency_trace *lookup(latency_handle_t handle)
+{
+	struct latency_trace *t;
+
+	if (handle == 0) {
+		return NULL;
+	}
+	t = &traces[handle & SLOT_MASK];
+	if (t->gen != (handle >> SLOT_BITS)) {
+		return NULL;
+	}
+	return t;
+}
+
+static void release(latency_handle_t handle)
+{
+	struct latency_trace *t = &traces[handle & SLOT_MASK];
+
+	/* Bump the generation so handles to the old trace stop matching. */
+	t->gen = (t->gen % GEN_MAX) + 1;
+	atomic_clear_bit(&busy, handle & SLOT_MASK);
+}
+
+static void reclaim_stale(uint32_t now)
+{
+	for (int i = 0; i < TRACES; i++) {
+		if (atomic_test_bit(&busy, i) &&
+		    now - traces[i].stamp[LATENCY_RX] > STALE_CYCLES) {
+			release((traces[i].gen << SLOT_BITS) | i);
+			metric_inc(&metric_latency_stale);
+		}
+	}
+}
+
+latency_handle_t latency_start(enum latency_path path, uint32_t rx_cycles)
+{
+	struct latency_trace *t;
+
+	for (int i = 0; i < TRACES; i++) {
+		if (atomic_test_and_set_bit(&busy, i)) {
+			continue;
+		}
+		t = &traces[i];
+		if (t->gen == 0) {
+			t->gen = 1;
+		}
+		t->path = path;
+		t->stamped = BIT(LATENCY_RX);
+		t->stamp[LATENCY_RX] = rx_cycles;
+		return (t->gen << SLOT_BITS) | i;
+	}
+
+	metric_inc(&metric_latency_untraced);
+	reclaim_stale(k_cycle_get_32());
+	return 0;
+}
+
+void latency_stamp(latency_handle_t handle, enum latency_stage stage)
+{
+	struct latency_trace *t = lookup(handle);
+
+	if (t) {
+		t->stamp[stage] = k_cycle_get_32();
+		t->stamped |= BIT(stage);
+	}
+}
+
+void latency_finish(latency_handle_t handle)
+{
+	struct latency_trace *t = lookup(handle);
+	int prev = LATENCY_RX;
+
+	if (!t) {
+		return;
+	}
+	if (!(t->stamped & BIT(LATENCY_DONE))) {
+		t->stamp[LATENCY_DONE] = k_cycle_get_32();
+	}
+	for (int s = LATENCY_QUEUE; s < LATENCY_STAGE_NUM; s++) {
+		if (!(t->stamped & BIT(s)) && s != LATENCY_DONE) {
+			continue;
+		}
+		metric_observe(&stages[t->path][s - 1],
+			       k_cyc_to_us_floor32(t->stamp[s] - t->stamp[prev]));
+		prev = s;
+	}
+	metric_observe(totals[t->path],
+		       k_cyc_to_us_floor32(t->stamp[LATENCY_DONE] - t->stamp[LATENCY_RX]));
+	release(handle);
+}
+
+void latency_abort(latency_handle_t handle)
+{
+	if (lookup(handle)) {
+		release(handle);
+	}
+}
+
+static int latency_init(void)
+{
+	for (int p = 0; p < LATENCY_PATH_NUM; p++) {
+		for (int s = 0; s < LATENCY_STAGE_NUM - 1; s++) {
+			stages[p][s].type = METRIC_HISTOGRAM;
+			stages[p][s].buckets = stage_buckets[p][s];
+		}
+	}
+	return 0;
+}
+
+SYS_INIT(latency_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static void print_hist(const struct shell *sh, const char *name, struct metric *m)
+{
+	if (atomic_get(&m->value) == 0) {
+		return;
+	}
+	shell_print(sh, "  %-20s %8ld %8u %8u %8ld", name, atomic_get(&m->value),
+		    metric_percentile(m, 50), metric_percentile(m, 99), atomic_get(&m->max));
+}
+
+static int cmd_latency_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	char name[24];
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "latency in us, p50/p99 interpolated within 25%% buckets");
+	for (int p = 0; p < LATENCY_PATH_NUM; p++) {
+		shell_print(sh, "%s", path_names[p]);
+		shell_print(sh, "  %-20s %8s %8s %8s %8s", "stage", "count", "p50", "p99", "max");
+		for (int s = 1; s < LATENCY_STAGE_NUM; s++) {
+			snprintf(name, sizeof(name), "..%s", stage_names[s]);
+			print_hist(sh, name, &stages[p][s - 1]);
+		}
+		print_hist(sh, "total", totals[p]);
+	}
+	shell_print(sh, "untraced %ld, stale %ld", atomic_get(&metric_latency_untraced.value),
+		    atomic_get(&metric_latency_stale.value));
+	return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int p = 0; p < LATENCY_PATH_NUM; p++) {
+		for (int s = 0; s < LATENCY_STAGE_NUM - 1; s++) {
+			metric_reset(&stages[p][s]);
+		}
+		metric_reset(totals[p]);
+	}
+	metric_reset(&metric_latency_untraced);
+	metric_reset(&metric_latency_stale);
+	shell_print(sh, "latency histograms cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(latency_subcmd,
+	SHELL_CMD(reset, NULL, "Clear latency histograms", cmd_latency_reset),
+	SHELL_CMD(show, NULL, "Per-path, per-stage latency", cmd_latency_show),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(latency, &latency_subcmd, "Sensor to actuator latency", NULL);
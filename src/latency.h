@@ -0,0 +1,58 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * End-to-end latency tracing from an input to whatever consumes it: sensor
+ * notifications to the monitor, the CAN TX period to the drive frame on the
+ * bus, and the on/off button to the motor enable GPIO. A trace is started
+ * where the input arrives, its handle travels with the data (sample ring
+ * record, event entry, CAN TX callback argument) and each stage stamps
+ * k_cycle_get_32(). Finishing a trace records the stage-to-stage and total
+ * latency in per-path histograms.
+ *
+ * Only CONFIG_APP_LATENCY_TRACES inputs are in flight at a time; inputs that
+ * arrive while all slots are busy are not traced.
+ */
+
+enum latency_path {
+	LATENCY_FSR_MONITOR,
+	LATENCY_CONTROLLER_MONITOR,
+	LATENCY_TICK_CAN,
+	LATENCY_BUTTON_MOTOR,
+	LATENCY_PATH_NUM,
+};
+
+enum latency_stage {
+	LATENCY_RX,		/* BLE notification / TX period / button event */
+	LATENCY_QUEUE,		/* handed to the sample ring / event queue */
+	LATENCY_CONSUME,	/* picked up by the consumer */
+	LATENCY_ENQUEUE,	/* CAN frame queued / motor GPIO about to change */
+	LATENCY_DONE,		/* monitor done / CAN TX complete / GPIO changed */
+	LATENCY_STAGE_NUM,
+};
+
+/* 0 is never a valid handle, so it can mark untraced data. */
+typedef uint8_t latency_handle_t;
+
+#ifdef CONFIG_APP_LATENCY
+
+latency_handle_t latency_start(enum latency_path path, uint32_t rx_cycles);
+void latency_stamp(latency_handle_t handle, enum latency_stage stage);
+void latency_finish(latency_handle_t handle);
+void latency_abort(latency_handle_t handle);
+
+#else
+
+static inline latency_handle_t latency_start(enum latency_path path, uint32_t rx_cycles)
+{
+	return 0;
+}
+static inline void latency_stamp(latency_handle_t handle, enum latency_stage stage) {}
+static inline void latency_finish(latency_handle_t handle) {}
+static inline void latency_abort(latency_handle_t handle) {}
+
+#endif /* CONFIG_APP_LATENCY */
+
+#endif /* _LATENCY_H_ */
@@ -3,19 +3,26 @@
 #include <zephyr/drivers/display.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/kernel.h>
-#include <zephyr/settings/settings.h>
+#include <zephyr/zbus/zbus.h>
+
+#include "channels.h"
+#include "actor.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(led, LOG_LEVEL_INF);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
-
 static const struct gpio_dt_spec red_led = GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios);
 static const struct gpio_dt_spec green_led = GPIO_DT_SPEC_GET(DT_ALIAS(led1), gpios);
 static const struct gpio_dt_spec blue_led = GPIO_DT_SPEC_GET(DT_ALIAS(led2), gpios);
 
-K_SEM_DEFINE(led_sem, 0, 1);
+enum led_flag {
+	FLAG_UPDATE,
+	FLAG_TICK,
+	FLAG_NUM,
+};
+
+static void led_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(led_actor, actor_bg_q, led_handler, CONFIG_APP_DEADLINE_LED_US);
 
 typedef struct {
     bool red;
@@ -97,7 +104,7 @@ static void set_led_pattern(const led_pattern_t *pattern)
     led_state.pattern = pattern;
     if (!led_state.event_pattern) {
         led_state.index = 0;
-        k_sem_give(&led_sem);
+        actor_post(&led_actor, FLAG_UPDATE);
     }
 }
 
@@ -105,22 +112,51 @@ static void set_led_event_pattern(const led_pattern_t *pattern)
 {
     led_state.event_pattern = pattern;
     led_state.index = 0;
-    k_sem_give(&led_sem);
+    actor_post(&led_actor, FLAG_UPDATE);
+}
+
+/* Show the next step of the active pattern and arm the timer for the one after. */
+static void led_handler(struct actor *actor, uint32_t msgs)
+{
+    k_timeout_t duration = K_FOREVER;
+
+    ARG_UNUSED(msgs);
+
+    if (led_state.event_pattern) {
+        duration = set_leds(&led_state.event_pattern[led_state.index]);
+        led_state.index++;
+        if (K_TIMEOUT_EQ(led_state.event_pattern[led_state.index].duration, K_NO_WAIT)) {
+            led_state.index = 0;
+            led_state.event_pattern = NULL; // Clear event pattern after completion
+        }
+    } else if (led_state.pattern) {
+        duration = set_leds(&led_state.pattern[led_state.index]);
+        led_state.index++;
+        if (K_TIMEOUT_EQ(led_state.pattern[led_state.index].duration, K_NO_WAIT)) {
+            led_state.index = 0;
+        }
+    }
+
+    if (K_TIMEOUT_EQ(duration, K_FOREVER)) {
+        actor_cancel_delayed(actor);
+    } else {
+        actor_post_delayed(actor, FLAG_TICK, duration);
+    }
 }
 
-static void led_thread(void)
+static int led_init(void)
 {
 	if (!gpio_is_ready_dt(&red_led)) {
 		LOG_ERR("Error: device %s not ready", red_led.port->name);
-		return;
+		return -ENODEV;
 	}
 	if (!gpio_is_ready_dt(&green_led)) {
 		LOG_ERR("Error: device %s not ready", green_led.port->name);
-		return;
+		return -ENODEV;
 	}
 	if (!gpio_is_ready_dt(&blue_led)) {
 		LOG_ERR("Error: device %s not ready", blue_led.port->name);
-		return;
+		return -ENODEV;
 	}
 
     gpio_pin_configure_dt(&red_led, GPIO_OUTPUT_ACTIVE);
@@ -128,73 +164,40 @@ static void led_thread(void)
     gpio_pin_configure_dt(&blue_led, GPIO_OUTPUT_ACTIVE);
 
     set_led_event_pattern(led_off);
-    k_timeout_t duration = K_FOREVER;
-	while (1) {
-        k_sem_take(&led_sem, duration);
-        if (led_state.event_pattern) {
-            duration = set_leds(&led_state.event_pattern[led_state.index]);
-            led_state.index++;
-            if (K_TIMEOUT_EQ(led_state.event_pattern[led_state.index].duration, K_NO_WAIT)) {
-                led_state.index = 0;
-                led_state.event_pattern = NULL; // Clear event pattern after completion
-            }
-        } else if (led_state.pattern) {
-            duration = set_leds(&led_state.pattern[led_state.index]);
-            led_state.index++;
-            if (K_TIMEOUT_EQ(led_state.pattern[led_state.index].duration, K_NO_WAIT)) {
-                led_state.index = 0;
-            }
-        } else {
-            duration = K_FOREVER;
-        }
-
-	}
+    return 0;
 }
 
-K_THREAD_DEFINE(led_id, STACKSIZE, led_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
-
+SYS_INIT(led_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 
 
-
-int led_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+static void led_listener(const struct zbus_channel *chan)
 {
-	const char *next;
-	size_t name_len;
-	// int err;
-
-	name_len = settings_name_next(name, &next);
-	if (!next) {
-		if (!strncmp(name, "poweron", name_len)) {
-			LOG_INF("<led/poweron>");
-            set_led_event_pattern(power_on);
-            set_led_pattern(blue_blinking); // Set a default pattern after power on
-			return 0;
-		}
-		if (!strncmp(name, "poweroff", name_len)) {
-			LOG_INF("<led/poweroff>");
-            set_led_event_pattern(power_off);
-            set_led_pattern(led_off); // Set a default pattern after power off
-			return 0;
-		}
-		if (!strncmp(name, "standby", name_len)) {
-			LOG_INF("<led/standby>");
-            set_led_pattern(blue_blinking); 
-			return 0;
-		}
-		if (!strncmp(name, "ready", name_len)) {
-			LOG_INF("<led/ready>");
-            set_led_pattern(green_blinking); 
-			return 0;
-		}
-		if (!strncmp(name, "pairing", name_len)) {
-			LOG_INF("<led/pairing>");
-            set_led_pattern(red_blue_alternating); 
-			return 0;
-		}
+	const struct led_msg *msg = zbus_chan_const_msg(chan);
+
+	switch (msg->cmd) {
+	case LED_POWERON:
+		LOG_INF("<led/poweron>");
+		set_led_event_pattern(power_on);
+		set_led_pattern(blue_blinking); // Set a default pattern after power on
+		break;
+	case LED_POWEROFF:
+		LOG_INF("<led/poweroff>");
+		set_led_event_pattern(power_off);
+		set_led_pattern(led_off); // Set a default pattern after power off
+		break;
+	case LED_STANDBY:
+		LOG_INF("<led/standby>");
+		set_led_pattern(blue_blinking);
+		break;
+	case LED_READY:
+		LOG_INF("<led/ready>");
+		set_led_pattern(green_blinking);
+		break;
+	case LED_PAIRING:
+		LOG_INF("<led/pairing>");
+		set_led_pattern(red_blue_alternating);
+		break;
 	}
-	return -ENOENT;
 }
-/* static subtree handler */
-SETTINGS_STATIC_HANDLER_DEFINE(led, "led", NULL, led_handle_set, NULL, NULL);
-
 
+ZBUS_LISTENER_DEFINE(led_lis, led_listener);
@@ -0,0 +1,223 @@
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "link_stats.h"
+
+LOG_MODULE_REGISTER(link_stats, LOG_LEVEL_INF);
+
+#define JITTER_SHIFT 4
+
+void link_stats_notify(struct link_stats *ls)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t last = ls->last_rx;
+	uint32_t dt_us, period_us, dev_us;
+
+	ls->last_rx = now;
+	ls->notifications++;
+	if (!last) {
+		if (!ls->first_data_ms) {
+			ls->first_data_ms = (uint32_t)k_uptime_get();
+		}
+		if (ls->down_at) {
+			ls->resume_ms = (uint32_t)(k_uptime_get() - ls->down_at);
+		}
+		return;
+	}
+
+	dt_us = k_cyc_to_us_floor32(now - last);
+	metric_observe(ls->interarrival, dt_us);
+	if (dt_us > ls->max_gap_us) {
+		ls->max_gap_us = dt_us;
+	}
+	if (!ls->period_ms) {
+		return;
+	}
+
+	period_us = ls->period_ms * USEC_PER_MSEC;
+	if (dt_us > period_us + period_us / 2) {
+		ls->missed += (dt_us + period_us / 2) / period_us - 1;
+	}
+	if (dt_us > period_us * CONFIG_APP_LINK_GAP_PERIODS) {
+		ls->gaps++;
+		return;
+	}
+	dev_us = dt_us > period_us ? dt_us - period_us : period_us - dt_us;
+	ls->jitter_us += ((int32_t)dev_us - (int32_t)ls->jitter_us) >> JITTER_SHIFT;
+}
+
+void link_stats_connected(struct link_stats *ls, struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	ls->connects++;
+	ls->connected_at = k_uptime_get();
+	ls->last_rx = 0;
+	if (ls->down_at) {
+		ls->reconnect_ms = (uint32_t)(ls->connected_at - ls->down_at);
+	}
+	if (bt_conn_get_info(conn, &info) == 0) {
+		ls->interval = info.le.interval;
+		ls->latency = info.le.latency;
+		ls->timeout = info.le.timeout;
+	}
+}
+
+void link_stats_disconnected(struct link_stats *ls, uint8_t reason)
+{
+	ls->disconnects++;
+	ls->last_reason = reason;
+	ls->down_at = k_uptime_get();
+	if (ls->connected_at) {
+		ls->connected_ms += (uint32_t)(k_uptime_get() - ls->connected_at);
+		ls->connected_at = 0;
+	}
+}
+
+void link_stats_param_updated(struct link_stats *ls, uint16_t interval, uint16_t latency,
+			      uint16_t timeout)
+{
+	ls->param_updates++;
+	ls->interval = interval;
+	ls->latency = latency;
+	ls->timeout = timeout;
+}
+
+int link_stats_sample_rssi(struct link_stats *ls, struct bt_conn *conn)
+{
+	struct bt_hci_cp_read_rssi *cp;
+	struct bt_hci_rp_read_rssi *rp;
+	struct net_buf *buf, *rsp;
+	uint16_t handle;
+	int err;
+
+	err = bt_hci_get_conn_handle(conn, &handle);
+	if (err) {
+		return err;
+	}
+	buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+	if (err) {
+		return err;
+	}
+	rp = (void *)rsp->data;
+	if (!ls->rssi_samples || rp->rssi < ls->rssi_min) {
+		ls->rssi_min = rp->rssi;
+	}
+	if (!ls->rssi_samples || rp->rssi > ls->rssi_max) {
+		ls->rssi_max = rp->rssi;
+	}
+	ls->rssi = rp->rssi;
+	ls->rssi_sum += rp->rssi;
+	ls->rssi_samples++;
+	net_buf_unref(rsp);
+	return 0;
+}
+
+void link_stats_reset(struct link_stats *ls)
+{
+	ls->notifications = 0;
+	ls->gaps = 0;
+	ls->missed = 0;
+	ls->max_gap_us = 0;
+	ls->jitter_us = 0;
+	ls->rssi_sum = 0;
+	ls->rssi_samples = 0;
+	ls->param_updates = 0;
+	ls->connects = ls->connected_at ? 1 : 0;
+	ls->disconnects = 0;
+	ls->last_reason = 0;
+	ls->connected_ms = 0;
+	ls->reconnect_ms = 0;
+	ls->resume_ms = 0;
+	if (ls->connected_at) {
+		ls->connected_at = k_uptime_get();
+	}
+	metric_reset(ls->interarrival);
+}
+
+static int8_t rssi_avg(const struct link_stats *ls)
+{
+	return ls->rssi_samples ? (int8_t)(ls->rssi_sum / (int32_t)ls->rssi_samples) : 0;
+}
+
+static uint32_t session_ms(const struct link_stats *ls)
+{
+	return ls->connected_at ? (uint32_t)(k_uptime_get() - ls->connected_at) : 0;
+}
+
+void link_stats_print(const struct shell *sh, const char *name, const struct link_stats *ls)
+{
+	uint32_t session = session_ms(ls);
+
+	shell_print(sh, "%s: %s for %u s, %u s connected in total", name,
+		    ls->connected_at ? "up" : "down", session / MSEC_PER_SEC,
+		    (ls->connected_ms + session) / MSEC_PER_SEC);
+	shell_print(sh, "  connects %u, disconnects %u (last reason 0x%02x)", ls->connects,
+		    ls->disconnects, ls->last_reason);
+	shell_print(sh, "  interval %u.%02u ms, latency %u, timeout %u ms, %u updates",
+		    ls->interval * 5 / 4, (ls->interval * 125) % 100, ls->latency,
+		    ls->timeout * 10, ls->param_updates);
+	shell_print(sh, "  notifications %u, inter-arrival p50 %u us, p99 %u us, max %u us",
+		    ls->notifications, metric_percentile(ls->interarrival, 50),
+		    metric_percentile(ls->interarrival, 99), ls->max_gap_us);
+	if (ls->period_ms) {
+		shell_print(sh, "  period %u ms, gaps %u, missed %u, jitter %u us", ls->period_ms,
+			    ls->gaps, ls->missed, ls->jitter_us);
+	}
+	shell_print(sh, "  first notification at %u ms, reconnect %u ms, data resumed %u ms",
+		    ls->first_data_ms, ls->reconnect_ms, ls->resume_ms);
+	if (ls->rssi_samples) {
+		shell_print(sh, "  rssi %d dBm, min %d, max %d, avg %d (%u samples)", ls->rssi,
+			    ls->rssi_min, ls->rssi_max, rssi_avg(ls), ls->rssi_samples);
+	}
+}
+
+size_t link_stats_encode(const char *name, const struct link_stats *ls, uint8_t *buf,
+			 size_t size)
+{
+	size_t name_len = strlen(name) + 1;
+	size_t len = name_len + 6 * 4 + 4 + 6 * 2 + 1 + 6 * 4;
+	uint32_t session = session_ms(ls);
+	uint8_t *p = buf + name_len;
+
+	if (len > size) {
+		return 0;
+	}
+	memcpy(buf, name, name_len);
+	sys_put_le32(ls->notifications, p);
+	sys_put_le32(ls->gaps, p + 4);
+	sys_put_le32(ls->max_gap_us, p + 8);
+	sys_put_le32(ls->jitter_us, p + 12);
+	sys_put_le32(metric_percentile(ls->interarrival, 50), p + 16);
+	sys_put_le32(metric_percentile(ls->interarrival, 99), p + 20);
+	p += 24;
+	*p++ = (uint8_t)ls->rssi;
+	*p++ = (uint8_t)ls->rssi_min;
+	*p++ = (uint8_t)ls->rssi_max;
+	*p++ = (uint8_t)rssi_avg(ls);
+	sys_put_le16(ls->interval, p);
+	sys_put_le16(ls->latency, p + 2);
+	sys_put_le16(ls->timeout, p + 4);
+	sys_put_le16(ls->param_updates, p + 6);
+	sys_put_le16(ls->connects, p + 8);
+	sys_put_le16(ls->disconnects, p + 10);
+	p += 12;
+	*p++ = ls->last_reason;
+	sys_put_le32(session / MSEC_PER_SEC, p);
+	sys_put_le32((ls->connected_ms + session) / MSEC_PER_SEC, p + 4);
+	sys_put_le32(ls->missed, p + 8);
+	sys_put_le32(ls->first_data_ms, p + 12);
+	sys_put_le32(ls->reconnect_ms, p + 16);
+	sys_put_le32(ls->resume_ms, p + 20);
+	return len;
+}
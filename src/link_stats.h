@@ -0,0 +1,86 @@
+#ifndef _LINK_STATS_H_
+#define _LINK_STATS_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+
+#include "metrics.h"
+
+/*
+ * Radio link quality of one GATT client connection: notification
+ * inter-arrival times, gaps, RSSI, parameter updates and connection
+ * history. Notification updates run in the BT RX thread and cost a cycle
+ * read and a few adds; RSSI is polled by the BLE manager.
+ */
+
+struct link_stats {
+	/* Expected notification period, 0 for event driven links (no gap or jitter tracking). */
+	uint16_t period_ms;
+	struct metric *interarrival;	/* histogram in us, registered by the client */
+
+	uint32_t notifications;
+	uint32_t last_rx;		/* cycles, 0 until the first notification */
+	uint32_t gaps;			/* inter-arrival over CONFIG_APP_LINK_GAP_PERIODS periods */
+	uint32_t missed;		/* notifications estimated lost from inter-arrival / period */
+	uint32_t max_gap_us;
+	uint32_t jitter_us;		/* smoothed |inter-arrival - period|, RFC 3550 style */
+
+	int8_t rssi;
+	int8_t rssi_min;
+	int8_t rssi_max;
+	int32_t rssi_sum;
+	uint32_t rssi_samples;
+
+	uint16_t interval;		/* current parameters, 1.25 ms / events / 10 ms units */
+	uint16_t latency;
+	uint16_t timeout;
+	uint16_t param_updates;
+
+	uint16_t connects;
+	uint16_t disconnects;
+	uint8_t last_reason;
+	int64_t connected_at;		/* k_uptime_get(), 0 while disconnected */
+	uint32_t connected_ms;		/* previous sessions */
+
+	/* Recovery timing, all in ms. */
+	int64_t down_at;		/* k_uptime_get() at the last disconnect, 0 if none */
+	uint32_t first_data_ms;		/* uptime at the first notification since boot */
+	uint32_t reconnect_ms;		/* last disconnect to connected */
+	uint32_t resume_ms;		/* last disconnect to the first notification after it */
+};
+
+#define LINK_STATS_INIT(_period_ms, _interarrival)                             \
+	{                                                                      \
+		.period_ms = _period_ms,                                       \
+		.interarrival = &_interarrival,                                \
+	}
+
+void link_stats_notify(struct link_stats *ls);
+void link_stats_connected(struct link_stats *ls, struct bt_conn *conn);
+void link_stats_disconnected(struct link_stats *ls, uint8_t reason);
+void link_stats_param_updated(struct link_stats *ls, uint16_t interval, uint16_t latency,
+			      uint16_t timeout);
+
+/* Read RSSI of conn from the controller and record it. Blocks on HCI. */
+int link_stats_sample_rssi(struct link_stats *ls, struct bt_conn *conn);
+
+/* Clear counters, keep the connection state. */
+void link_stats_reset(struct link_stats *ls);
+
+void link_stats_print(const struct shell *sh, const char *name, const struct link_stats *ls);
+
+/*
+ * Append one record: NUL-terminated name, then little endian notifications,
+ * gaps, max gap us, jitter us, inter-arrival p50 and p99 us (u32 each),
+ * RSSI last, min, max, average (i8 each), interval, latency, timeout,
+ * parameter updates, connects, disconnects (u16 each), last disconnect
+ * reason (u8), current session and total connected seconds, missed
+ * notifications, first notification after boot ms, reconnect ms and
+ * resume ms (u32 each).
+ * Returns the bytes written, 0 if it does not fit.
+ */
+size_t link_stats_encode(const char *name, const struct link_stats *ls, uint8_t *buf,
+			 size_t size);
+
+#endif /* _LINK_STATS_H_ */
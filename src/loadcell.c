@@ -5,49 +5,76 @@
 #include <zephyr/drivers/adc.h>
 #include <zephyr/logging/log.h>
 
+#include "actor.h"
+#include "sample_ring.h"
+
 LOG_MODULE_REGISTER(loadcell, LOG_LEVEL_INF);
 
-#define STACKSIZE 1024
-#define PRIORITY 7
+#define SAMPLE_INTERVAL K_MSEC(CONFIG_APP_LOADCELL_PERIOD_MS)
 
 static const struct adc_dt_spec adc_channel = ADC_DT_SPEC_GET_BY_NAME(DT_PATH(zephyr_user), loadcell);
 
-K_SEM_DEFINE(read_sem, 0, 1);
+enum loadcell_flag {
+	FLAG_READ,
+	FLAG_NUM,
+};
+
+static uint16_t raw;
+static struct adc_sequence sequence = {
+	.buffer = &raw,
+	.buffer_size = sizeof(raw),
+};
+
+static void loadcell_handler(struct actor *actor, uint32_t msgs)
+{
+	struct sample *sample;
+	uint32_t stamp;
+	int err;
+
+	ARG_UNUSED(msgs);
+
+	actor_post_delayed(actor, FLAG_READ, SAMPLE_INTERVAL);
 
+	LOG_DBG("ADC reading:");
+	adc_sequence_init_dt(&adc_channel, &sequence);
+	stamp = k_cycle_get_32();
+	err = adc_read_dt(&adc_channel, &sequence);
+	if (err < 0) {
+		LOG_ERR("Could not read (%d)", err);
+		return;
+	}
+	LOG_DBG("sample: %d", raw);
+	if (sample_live_muted()) {
+		return;
+	}
+
+	sample = sample_claim(SAMPLE_LOADCELL, 0, stamp);
+	sample->loadcell = raw;
+	sample->len = sizeof(raw);
+	sample_publish(sample);
+}
 
-static void loadcell_thread(void)
+static ACTOR_DEFINE(loadcell_actor, actor_sensor_q, loadcell_handler,
+		    CONFIG_APP_DEADLINE_LOADCELL_US);
+
+static int loadcell_init(void)
 {
 	int err;
-	uint16_t sample;
-	struct adc_sequence sequence = {
-        .buffer = &sample,
-        .buffer_size = sizeof(sample),
-    };
 
 	/* Configure channels individually prior to sampling. */
     if (!adc_is_ready_dt(&adc_channel)) {
         LOG_ERR("ADC controller device %s not ready", adc_channel.dev->name);
-        return;
+        return -ENODEV;
     }
 
     err = adc_channel_setup_dt(&adc_channel);
     if (err < 0) {
         LOG_ERR("Could not setup channel (%d)", err);
-        return;
+        return err;
     }
 
-	while (1) {
-        k_sem_take(&read_sem, K_MSEC(1000));
-		LOG_DBG("ADC reading:");
-        adc_sequence_init_dt(&adc_channel, &sequence);
-        err = adc_read_dt(&adc_channel, &sequence);
-        if (err < 0) {
-            LOG_ERR("Could not read (%d)", err);
-            continue;
-        }
-        LOG_DBG("sample: %d", sample);
-	}
+	actor_post_delayed(&loadcell_actor, FLAG_READ, SAMPLE_INTERVAL);
+	return 0;
 }
 
-K_THREAD_DEFINE(loadcell_id, STACKSIZE, loadcell_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
-
+SYS_INIT(loadcell_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
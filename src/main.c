@@ -12,6 +12,8 @@
 #include <zephyr/kernel.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/hci.h>
@@ -25,80 +27,210 @@
 
 #include "bt_main.h"
 #include "config_svc.h"
+#include "sample_ring.h"
+#include "latency.h"
+#include "boot.h"
 
 
 LOG_MODULE_REGISTER(main);
 
-#define FSR_TAG 		0x01
-#define CONTROLLER_TAG 	0x02 
+#define DRAIN_BATCH 32
+#define MONITOR_WINDOW_MIN_MS 100
+#define MONITOR_WINDOW_MAX_MS 60000
 
 enum debug_flag {
 	FLAG_FSR = 0,
 	FLAG_CONTROLLER,
+	FLAG_STATS,
 	FLAG_NUM,
 };
 
 static ATOMIC_DEFINE(flags, FLAG_NUM);
+static SAMPLE_READER_DEFINE(monitor_reader);
+
+/*
+ * Windowed statistics per sensor channel. Each sample only adds to a few
+ * sums; mean and variance are worked out once per window when printing.
+ */
+enum stat_channel {
+	CH_FSR0,
+	CH_FSR1,
+	CH_FSR2,
+	CH_FSR3,
+	CH_CONTROLLER,
+	CH_IMU,			/* value is the frame length, sum gives bytes */
+	CH_LOADCELL,
+	CH_CAN,			/* value is the data length */
+	CH_NUM,
+};
+
+static const char *const channel_names[CH_NUM] = {
+	[CH_FSR0] = "fsr0",
+	[CH_FSR1] = "fsr1",
+	[CH_FSR2] = "fsr2",
+	[CH_FSR3] = "fsr3",
+	[CH_CONTROLLER] = "controller",
+	[CH_IMU] = "imu",
+	[CH_LOADCELL] = "loadcell",
+	[CH_CAN] = "can",
+};
+
+struct channel_stats {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint64_t sum_sq;
+};
+
+static struct channel_stats stats[CH_NUM];
+static uint32_t window_ms = CONFIG_APP_MONITOR_WINDOW_MS;
+
+static inline void stats_add(enum stat_channel ch, uint32_t value)
+{
+	struct channel_stats *st = &stats[ch];
+
+	if (!st->count || value < st->min) {
+		st->min = value;
+	}
+	if (value > st->max) {
+		st->max = value;
+	}
+	st->count++;
+	st->sum += value;
+	st->sum_sq += (uint64_t)value * value;
+}
+
+static void stats_print(uint32_t elapsed_ms)
+{
+	for (int i = 0; i < CH_NUM; i++) {
+		struct channel_stats *st = &stats[i];
+		uint32_t var = 0;
+		uint32_t mean10, rate10;
+
+		if (!st->count) {
+			continue;
+		}
+		if (st->count > 1) {
+			/*
+			 * sum * sum overflows past 2^16 full scale samples, so
+			 * split sum = q * count + r: sum^2 / count is then
+			 * sum * q + q * r + r^2 / count, none of which can.
+			 * Samples are 16 bit, the variance fits in 32.
+			 */
+			uint64_t q = st->sum / st->count;
+			uint64_t r = st->sum % st->count;
+
+			var = (uint32_t)((st->sum_sq - st->sum * q - q * r - r * r / st->count) /
+					 (st->count - 1));
+		}
+		mean10 = (uint32_t)(st->sum * 10 / st->count);
+		rate10 = elapsed_ms ? (uint32_t)((uint64_t)st->count * 10000 / elapsed_ms) : 0;
+		if (i == CH_IMU || i == CH_CAN) {
+			LOG_INF("%-10s %5u.%u/s %6u B/s len %u..%u", channel_names[i], rate10 / 10,
+				rate10 % 10, (uint32_t)(st->sum * 1000 / MAX(elapsed_ms, 1)), st->min,
+				st->max);
+		} else {
+			LOG_INF("%-10s %5u.%u/s min %u max %u mean %u.%u var %u", channel_names[i],
+				rate10 / 10, rate10 % 10, st->min, st->max, mean10 / 10, mean10 % 10,
+				var);
+		}
+	}
+	memset(stats, 0, sizeof(stats));
+}
+
+static void monitor_stats(const struct sample *sample)
+{
+	switch (sample->tag) {
+	case SAMPLE_FSR:
+		for (int i = 0; i < ARRAY_SIZE(sample->fsr.value); i++) {
+			stats_add(CH_FSR0 + i, sample->fsr.value[i]);
+		}
+		break;
+	case SAMPLE_CONTROLLER:
+		stats_add(CH_CONTROLLER, sample->controller.value);
+		break;
+	case SAMPLE_IMU:
+		stats_add(CH_IMU, sample->len);
+		break;
+	case SAMPLE_LOADCELL:
+		stats_add(CH_LOADCELL, sample->loadcell);
+		break;
+	case SAMPLE_CAN:
+		stats_add(CH_CAN, sample->len);
+		break;
+	default:
+		break;
+	}
+}
+
+static void monitor_sample(const struct sample *sample, void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	/* The monitor is the consumer FSR and controller traces end at. */
+	latency_stamp(sample->trace, LATENCY_CONSUME);
+	if (atomic_test_bit(flags, FLAG_STATS)) {
+		monitor_stats(sample);
+	}
+
+	switch (sample->tag) {
 #ifdef CONFIG_HAS_BLE_FSR
-K_MSGQ_DEFINE(fsr_msgq, sizeof(struct fsr_data), 10, 1);
-#endif
-#ifdef CONFIG_HAS_BLE_CONTROLLER
-K_MSGQ_DEFINE(controller_msgq, sizeof(struct controller_data), 10, 1);
-#endif
-struct k_poll_event events[] = {
-#ifdef CONFIG_HAS_BLE_FSR
-    K_POLL_EVENT_STATIC_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
-                                    K_POLL_MODE_NOTIFY_ONLY,
-                                    &fsr_msgq, FSR_TAG),
+	case SAMPLE_FSR:
+		if (atomic_test_bit(flags, FLAG_FSR)) {
+			LOG_INF("FSR data: %u %u %u %u", sample->fsr.value[0], sample->fsr.value[1],
+				sample->fsr.value[2], sample->fsr.value[3]);
+		}
+		break;
 #endif
 #ifdef CONFIG_HAS_BLE_CONTROLLER
-    K_POLL_EVENT_STATIC_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
-                                    K_POLL_MODE_NOTIFY_ONLY,
-                                    &controller_msgq, CONTROLLER_TAG),
+	case SAMPLE_CONTROLLER:
+		if (atomic_test_bit(flags, FLAG_CONTROLLER)) {
+			LOG_INF("Controller data: %u", sample->controller.value);
+		}
+		break;
 #endif
-};
+	case SAMPLE_CAN:
+		LOG_DBG("CAN frame ID: 0x%08x, len: %u", sample->can.id, sample->len);
+		break;
+	default:
+		break;
+	}
+	latency_finish(sample->trace);
+}
 
 int main(void)
 {
+	uint32_t overruns = 0;
+	int64_t window_start = k_uptime_get();
+	k_timeout_t timeout;
+	int64_t now;
+
+	boot_stage_end(BOOT_APP_INIT, 0);
 	LOG_INF("Application Version: %s", APP_VERSION_EXTENDED_STRING);
 
+	if (sample_reader_register(&monitor_reader) != 0) {
+		return 0;
+	}
+
 	while (1) {
-		int err = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-		if (err) {
-			LOG_ERR("k_poll failed: %d", err);
-			continue;
+		timeout = K_FOREVER;
+		if (atomic_test_bit(flags, FLAG_STATS)) {
+			now = k_uptime_get();
+			if (now - window_start >= window_ms) {
+				stats_print((uint32_t)(now - window_start));
+				window_start = now;
+			}
+			timeout = K_MSEC(window_start + window_ms - now);
+		} else {
+			window_start = k_uptime_get();
 		}
-
-		for (int i = 0; i < ARRAY_SIZE(events); i++) {
-#ifdef CONFIG_HAS_BLE_FSR	
-			if (events[i].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE && events[i].tag == FSR_TAG) {
-				events[i].state = K_POLL_STATE_NOT_READY;
-				struct fsr_data data;
-				err = k_msgq_get(events[i].msgq, &data, K_NO_WAIT);
-				if (err) {
-					LOG_ERR("k_msgq_get failed: %d", err);
-					continue;
-				}
-				if (atomic_test_bit(flags, FLAG_FSR)) {
-					LOG_INF("FSR data: %u %u %u %u", data.value[0], data.value[1], data.value[2], data.value[3]);
-				}
-			}		
-#endif
-#ifdef CONFIG_HAS_BLE_CONTROLLER
-			if (events[i].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE && 
-				events[i].tag == CONTROLLER_TAG) {
-				struct controller_data data;
-				events[i].state = K_POLL_STATE_NOT_READY;
-				err = k_msgq_get(events[i].msgq, &data, K_NO_WAIT);
-				if (err) {
-					LOG_ERR("k_msgq_get failed: %d", err);
-					continue;
-				}
-				if (atomic_test_bit(flags, FLAG_CONTROLLER)) {
-					LOG_INF("Controller data: %u", data.value);
-				}
-			}	
-#endif
+		sample_reader_wait(&monitor_reader, timeout);
+		while (sample_reader_drain(&monitor_reader, monitor_sample, NULL, DRAIN_BATCH)) {
+		}
+		if (monitor_reader.overruns != overruns) {
+			LOG_WRN("Monitor lost %u samples", monitor_reader.overruns - overruns);
+			overruns = monitor_reader.overruns;
 		}
 	}
 
@@ -158,6 +290,34 @@ static int cmd_monitor_controller_stop(const struct shell *sh, size_t argc, char
 	return 0;
 }
 
+static int cmd_monitor_stats_start(const struct shell *sh, size_t argc, char *argv[])
+{
+	if (argc > 1) {
+		window_ms = CLAMP(strtoul(argv[1], NULL, 0), MONITOR_WINDOW_MIN_MS,
+				  MONITOR_WINDOW_MAX_MS);
+	}
+	if (atomic_test_and_set_bit(flags, FLAG_STATS)) {
+		shell_print(sh, "stats window %u ms\n", window_ms);
+		return 0;
+	}
+	/* Wake the monitor so it picks up the window. */
+	k_sem_give(&monitor_reader.sem);
+	shell_print(sh, "stats started, window %u ms\n", window_ms);
+	return 0;
+}
+
+static int cmd_monitor_stats_stop(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	if (!atomic_test_and_clear_bit(flags, FLAG_STATS)) {
+		shell_print(sh, "stats not started\n");
+		return 0;
+	}
+	shell_print(sh, "stats stopped\n");
+	return 0;
+}
 
 #define START_HELP ("<cmd>\n\nStart monitoring")
 #define STOP_HELP  ("<cmd>\n\nStop monitoring")
@@ -176,9 +336,17 @@ SHELL_STATIC_SUBCMD_SET_CREATE(controller_subcmd,
 	SHELL_SUBCMD_SET_END /* Array terminated. */
 );
 
+SHELL_STATIC_SUBCMD_SET_CREATE(stats_subcmd,
+	SHELL_CMD_ARG(start, NULL, "[window_ms]\n\nPrint per-channel statistics every window",
+		      cmd_monitor_stats_start, 1, 1),
+	SHELL_CMD_ARG(stop, NULL, STOP_HELP, cmd_monitor_stats_stop, 1, 0),
+	SHELL_SUBCMD_SET_END /* Array terminated. */
+);
+
 SHELL_STATIC_SUBCMD_SET_CREATE(monitor_subcmd,
 	SHELL_CMD(fsr, &fsr_subcmd, "FSR sensor data", NULL),
 	SHELL_CMD(controller, &controller_subcmd, "Controller data", NULL),
+	SHELL_CMD(stats, &stats_subcmd, "Windowed statistics of all sensor channels", NULL),
 	SHELL_SUBCMD_SET_END);
 
 SHELL_CMD_REGISTER(monitor, &monitor_subcmd, "Monitor commands", NULL);
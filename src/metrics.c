@@ -0,0 +1,147 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "metrics.h"
+
+LOG_MODULE_REGISTER(metrics, LOG_LEVEL_INF);
+
+static const char *const type_names[] = {
+	[METRIC_COUNTER] = "counter",
+	[METRIC_GAUGE] = "gauge",
+	[METRIC_HISTOGRAM] = "hist",
+};
+
+uint32_t metric_bucket_min(uint32_t i)
+{
+	if (i < METRIC_HIST_SUB) {
+		return i;
+	}
+	return (METRIC_HIST_SUB + i % METRIC_HIST_SUB) << (i / METRIC_HIST_SUB - 1);
+}
+
+uint32_t metric_bucket_max(uint32_t i)
+{
+	if (i < METRIC_HIST_SUB) {
+		return i;
+	}
+	return metric_bucket_min(i) + (BIT(i / METRIC_HIST_SUB - 1) - 1);
+}
+
+uint32_t metric_percentile(const struct metric *m, uint32_t percent)
+{
+	uint32_t max = atomic_get(&m->max);
+	uint64_t total = 0;
+	uint64_t target;
+	uint64_t seen = 0;
+	uint32_t n, lo, width;
+
+	for (int i = 0; i < METRIC_HIST_BUCKETS; i++) {
+		total += (uint32_t)atomic_get(&m->buckets[i]);
+	}
+	if (total == 0) {
+		return 0;
+	}
+	target = MAX(DIV_ROUND_UP(total * percent, 100), 1);
+	for (int i = 0; i < METRIC_HIST_BUCKETS; i++) {
+		n = atomic_get(&m->buckets[i]);
+		if (n && seen + n >= target) {
+			/* The samples of a bucket are taken as spread evenly over it. */
+			lo = metric_bucket_min(i);
+			width = metric_bucket_max(i) - lo + 1;
+			return (uint32_t)MIN(lo + ((uint64_t)width * (target - seen) - 1) / n, max);
+		}
+		seen += n;
+	}
+	return max;
+}
+
+void metric_reset(struct metric *m)
+{
+	atomic_clear(&m->max);
+	if (m->type != METRIC_GAUGE) {
+		atomic_clear(&m->value);
+	}
+	if (m->buckets) {
+		for (int i = 0; i < METRIC_HIST_BUCKETS; i++) {
+			atomic_clear(&m->buckets[i]);
+		}
+	}
+}
+
+/*
+ * One record per metric, little endian:
+ *   name (NUL terminated), type (u8), value (u32), max (u32),
+ *   histograms only: p50 (u32), p99 (u32)
+ * Records that do not fit are left out whole.
+ */
+size_t metrics_encode(uint8_t *buf, size_t size)
+{
+	size_t pos = 0;
+	size_t name_len, rec_len;
+
+	STRUCT_SECTION_FOREACH(metric, m) {
+		name_len = strlen(m->name) + 1;
+		rec_len = name_len + 1 + 8 + (m->type == METRIC_HISTOGRAM ? 8 : 0);
+		if (pos + rec_len > size) {
+			break;
+		}
+		memcpy(&buf[pos], m->name, name_len);
+		pos += name_len;
+		buf[pos++] = m->type;
+		sys_put_le32(atomic_get(&m->value), &buf[pos]);
+		sys_put_le32(atomic_get(&m->max), &buf[pos + 4]);
+		pos += 8;
+		if (m->type == METRIC_HISTOGRAM) {
+			sys_put_le32(metric_percentile(m, 50), &buf[pos]);
+			sys_put_le32(metric_percentile(m, 99), &buf[pos + 4]);
+			pos += 8;
+		}
+	}
+	return pos;
+}
+
+static int cmd_metrics_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+
+	shell_print(sh, "%-24s %-7s %10s %10s %8s %8s", "metric", "type", "value", "max",
+		    "p50", "p99");
+	STRUCT_SECTION_FOREACH(metric, m) {
+		if (filter && strncmp(m->name, filter, strlen(filter))) {
+			continue;
+		}
+		if (m->type == METRIC_HISTOGRAM) {
+			shell_print(sh, "%-24s %-7s %10ld %10ld %8u %8u", m->name,
+				    type_names[m->type], atomic_get(&m->value), atomic_get(&m->max),
+				    metric_percentile(m, 50), metric_percentile(m, 99));
+		} else {
+			shell_print(sh, "%-24s %-7s %10ld %10ld", m->name, type_names[m->type],
+				    atomic_get(&m->value), atomic_get(&m->max));
+		}
+	}
+	return 0;
+}
+
+static int cmd_metrics_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	STRUCT_SECTION_FOREACH(metric, m) {
+		metric_reset(m);
+	}
+	shell_print(sh, "metrics cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(metrics_subcmd,
+	SHELL_CMD(reset, NULL, "Clear counters, histograms and high-water marks",
+		  cmd_metrics_reset),
+	SHELL_CMD_ARG(show, NULL, "[prefix]\n\nList metrics, optionally by name prefix",
+		      cmd_metrics_show, 1, 1),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(metrics, &metrics_subcmd, "Runtime metrics", NULL);
@@ -0,0 +1,116 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/iterable_sections.h>
+
+/*
+ * Statically registered counters, gauges and log-linear histograms. Updates are
+ * single atomic operations and are safe from ISRs. Every metric defined with
+ * the macros below is listed by the "metrics" shell command and exported on
+ * the config service metrics characteristic.
+ */
+
+enum metric_type {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM,
+};
+
+/*
+ * Values below METRIC_HIST_SUB have a bucket each. Every octave above is
+ * split into METRIC_HIST_SUB equal buckets, so a bucket is at most a
+ * quarter of its lowest value wide, and the buckets cover all of uint32_t.
+ */
+#define METRIC_HIST_SUB_BITS 2
+#define METRIC_HIST_SUB BIT(METRIC_HIST_SUB_BITS)
+#define METRIC_HIST_BUCKETS (METRIC_HIST_SUB + (32 - METRIC_HIST_SUB_BITS) * METRIC_HIST_SUB)
+
+struct metric {
+	const char *name;
+	uint8_t type;
+	atomic_t value;		/* counter total, gauge level, histogram sample count */
+	atomic_t max;		/* gauge high-water mark, histogram largest sample */
+	atomic_t *buckets;	/* histograms only */
+};
+
+#define Z_METRIC_DEFINE(_var, _name, _type, _buckets)                          \
+	STRUCT_SECTION_ITERABLE(metric, _var) = {                              \
+		.name = _name,                                                 \
+		.type = _type,                                                 \
+		.buckets = _buckets,                                           \
+	}
+
+#define METRIC_COUNTER_DEFINE(_var, _name) Z_METRIC_DEFINE(_var, _name, METRIC_COUNTER, NULL)
+
+#define METRIC_GAUGE_DEFINE(_var, _name) Z_METRIC_DEFINE(_var, _name, METRIC_GAUGE, NULL)
+
+#define METRIC_HISTOGRAM_DEFINE(_var, _name)                                   \
+	static atomic_t _var##_buckets[METRIC_HIST_BUCKETS];                   \
+	Z_METRIC_DEFINE(_var, _name, METRIC_HISTOGRAM, _var##_buckets)
+
+#define METRIC_DECLARE(_var) extern struct metric _var
+
+static inline void metric_add(struct metric *m, uint32_t n)
+{
+	atomic_add(&m->value, n);
+}
+
+static inline void metric_inc(struct metric *m)
+{
+	atomic_inc(&m->value);
+}
+
+static inline void metric_track_max(struct metric *m, uint32_t v)
+{
+	atomic_val_t max;
+
+	do {
+		max = atomic_get(&m->max);
+		if ((uint32_t)max >= v) {
+			return;
+		}
+	} while (!atomic_cas(&m->max, max, v));
+}
+
+static inline void metric_set(struct metric *m, uint32_t v)
+{
+	atomic_set(&m->value, v);
+	metric_track_max(m, v);
+}
+
+static inline uint32_t metric_bucket(uint32_t v)
+{
+	uint32_t e;
+
+	if (v < METRIC_HIST_SUB) {
+		return v;
+	}
+	e = 31 - __builtin_clz(v) - METRIC_HIST_SUB_BITS;
+	return METRIC_HIST_SUB * (e + 1) + ((v >> e) & (METRIC_HIST_SUB - 1));
+}
+
+static inline void metric_observe(struct metric *m, uint32_t v)
+{
+	atomic_inc(&m->buckets[metric_bucket(v)]);
+	atomic_inc(&m->value);
+	metric_track_max(m, v);
+}
+
+/* Lowest and highest value counted in bucket i. */
+uint32_t metric_bucket_min(uint32_t i);
+uint32_t metric_bucket_max(uint32_t i);
+
+/*
+ * The given percentile, interpolated linearly within its bucket and never
+ * above the largest sample. 0 if empty.
+ */
+uint32_t metric_percentile(const struct metric *m, uint32_t percent);
+
+void metric_reset(struct metric *m);
+
+/* Binary export for the GATT characteristic; returns bytes written. */
+size_t metrics_encode(uint8_t *buf, size_t size);
+
+#endif /* _METRICS_H_ */
@@ -0,0 +1,23 @@
+#ifndef _MOTOR_CAN_H_
+#define _MOTOR_CAN_H_
+
+#include <zephyr/drivers/can.h>
+
+/*
+ * Divert the periodic motor drive frame to cb instead of the bus, so a
+ * session replay never drives the motors and its output timing can be
+ * kept. cb runs on the real-time actor queue and must not block. NULL
+ * sends to the bus again.
+ */
+typedef void (*can_capture_t)(const struct can_frame *frame);
+
+void can_capture_set(can_capture_t cb);
+
+/*
+ * While a capture is set the CONFIG_APP_CAN_TX_PERIOD_MS timer is ignored;
+ * the replay calls this once per period of recording time instead, so the
+ * captured frames line up with the replayed inputs at any speed.
+ */
+void can_capture_tick(void);
+
+#endif /* _MOTOR_CAN_H_ */
@@ -0,0 +1,102 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "prof.h"
+#include "tcm.h"
+
+LOG_MODULE_REGISTER(prof, LOG_LEVEL_INF);
+
+__app_itcm void prof_record(struct prof_site *site, uint32_t cycles)
+{
+	uint32_t bin = cycles ? MIN(31 - __builtin_clz(cycles), PROF_BINS - 1) : 0;
+	unsigned int key = irq_lock();
+
+	site->count++;
+	site->total += cycles;
+	if (cycles < site->min) {
+		site->min = cycles;
+	}
+	if (cycles > site->max) {
+		site->max = cycles;
+	}
+	site->bins[bin]++;
+	irq_unlock(key);
+}
+
+static int prof_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if defined(CONFIG_CPU_CORTEX_M7)
+	/* The M7 DWT is locked after reset. */
+	DWT->LAR = 0xC5ACCE55;
+#endif
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	return 0;
+}
+
+/* Before any driver enables the interrupts being profiled. */
+SYS_INIT(prof_init, PRE_KERNEL_1, 0);
+
+static int cmd_prof_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	bool bins = argc > 1 && !strcmp(argv[1], "bins");
+	struct prof_site snap;
+	unsigned int key;
+
+	shell_print(sh, "cycles at %u MHz", sys_clock_hw_cycles_per_sec() / 1000000);
+	shell_print(sh, "%-20s %8s %8s %8s %8s", "site", "count", "min", "avg", "max");
+	STRUCT_SECTION_FOREACH(prof_site, site) {
+		key = irq_lock();
+		snap = *site;
+		irq_unlock(key);
+
+		if (snap.count == 0) {
+			shell_print(sh, "%-20s %8u", snap.name, 0);
+			continue;
+		}
+		shell_print(sh, "%-20s %8u %8u %8u %8u", snap.name, snap.count, snap.min,
+			    (uint32_t)(snap.total / snap.count), snap.max);
+		if (!bins) {
+			continue;
+		}
+		for (int i = 0; i < PROF_BINS; i++) {
+			if (snap.bins[i]) {
+				shell_print(sh, "  %s%6u cyc %8u", i == PROF_BINS - 1 ? ">=" : "< ",
+					    i == PROF_BINS - 1 ? BIT(i) : BIT(i + 1), snap.bins[i]);
+			}
+		}
+	}
+	return 0;
+}
+
+static int cmd_prof_reset(const struct shell *sh, size_t argc, char *argv[])
+{
+	unsigned int key;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	STRUCT_SECTION_FOREACH(prof_site, site) {
+		key = irq_lock();
+		site->count = 0;
+		site->total = 0;
+		site->min = UINT32_MAX;
+		site->max = 0;
+		memset(site->bins, 0, sizeof(site->bins));
+		irq_unlock(key);
+	}
+	shell_print(sh, "profiling sites cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(prof_subcmd,
+	SHELL_CMD(reset, NULL, "Clear all sites", cmd_prof_reset),
+	SHELL_CMD_ARG(show, NULL, "[bins]\n\nPer-site cycles, optionally with histogram bins",
+		      cmd_prof_show, 1, 1),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(prof, &prof_subcmd, "DWT cycle profiling", NULL);
@@ -0,0 +1,64 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/iterable_sections.h>
+
+/*
+ * Entry/exit profiling scopes on the Cortex-M DWT cycle counter. A site
+ * keeps count, min, max, total and log2 bins of the cycles between
+ * PROF_START and PROF_END. Without CONFIG_APP_PROF all of it compiles to
+ * nothing.
+ *
+ *	PROF_SITE_DEFINE(uart_cb);
+ *
+ *	void uart_cb(...)
+ *	{
+ *		PROF_START(uart_cb);
+ *		...
+ *		PROF_END(uart_cb);
+ *	}
+ */
+
+/* Bin i counts scopes of [2^i, 2^(i+1)) cycles, the last bin everything above. */
+#define PROF_BINS 16
+
+struct prof_site {
+	const char *name;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t bins[PROF_BINS];
+};
+
+#ifdef CONFIG_APP_PROF
+
+#include <cmsis_core.h>
+
+static ALWAYS_INLINE uint32_t prof_now(void)
+{
+	return DWT->CYCCNT;
+}
+
+void prof_record(struct prof_site *site, uint32_t cycles);
+
+#define PROF_SITE_DEFINE(_name)                                                \
+	STRUCT_SECTION_ITERABLE(prof_site, prof_site_##_name) = {              \
+		.name = #_name,                                                \
+		.min = UINT32_MAX,                                             \
+	}
+
+#define PROF_START(_name) uint32_t _prof_start_##_name = prof_now()
+
+#define PROF_END(_name) prof_record(&prof_site_##_name, prof_now() - _prof_start_##_name)
+
+#else
+
+#define PROF_SITE_DEFINE(_name) BUILD_ASSERT(1)
+#define PROF_START(_name)
+#define PROF_END(_name)
+
+#endif /* CONFIG_APP_PROF */
+
+#endif /* _PROF_H_ */
@@ -0,0 +1,179 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/logging/log.h>
+
+#include "sample_ring.h"
+#include "tcm.h"
+#include "metrics.h"
+
+LOG_MODULE_REGISTER(sample_ring, LOG_LEVEL_INF);
+
+#define RING_SIZE CONFIG_APP_SAMPLE_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE), "sample ring size must be a power of two");
+
+METRIC_COUNTER_DEFINE(metric_sample_published, "sample.published");
+METRIC_COUNTER_DEFINE(metric_sample_overrun, "sample.overrun");
+METRIC_HISTOGRAM_DEFINE(metric_sample_batch, "sample.batch");
+
+static struct {
+	struct sample slot[RING_SIZE];
+	uint32_t claimed[RING_SIZE];	/* full index of the claim per slot, for publish */
+	atomic_t head;
+	/* Slots may be NULL below reader_count once a reader has left. */
+	struct sample_reader *readers[CONFIG_APP_SAMPLE_READERS_MAX];
+	atomic_t reader_count;
+} ring __app_dtcm_bss;
+
+static struct k_spinlock reader_lock;
+static atomic_t live_muted;
+
+__app_itcm struct sample *sample_claim(enum sample_tag tag, uint8_t src, uint32_t cycles)
+{
+	uint32_t idx = (uint32_t)atomic_inc(&ring.head);
+	struct sample *sample = &ring.slot[idx & RING_MASK];
+
+	sample->seq = 0;
+	barrier_dmem_fence_full();
+	sample->cycles = cycles;
+	sample->tag = tag;
+	sample->src = src;
+	sample->len = 0;
+	sample->trace = 0;
+	ring.claimed[idx & RING_MASK] = idx;
+	return sample;
+}
+
+__app_itcm void sample_publish(struct sample *sample)
+{
+	uint32_t idx = ring.claimed[sample - ring.slot];
+	int count;
+
+	barrier_dmem_fence_full();
+	*(volatile uint32_t *)&sample->seq = idx + 1;
+	metric_inc(&metric_sample_published);
+
+	count = atomic_get(&ring.reader_count);
+	for (int i = 0; i < count; i++) {
+		struct sample_reader *reader = ring.readers[i];
+
+		if (reader != NULL && atomic_cas(&reader->wake_pending, 0, 1)) {
+			k_sem_give(&reader->sem);
+		}
+	}
+}
+
+int sample_reader_register(struct sample_reader *reader)
+{
+	k_spinlock_key_t key = k_spin_lock(&reader_lock);
+	int i;
+
+	for (i = 0; i < CONFIG_APP_SAMPLE_READERS_MAX; i++) {
+		if (ring.readers[i] == NULL) {
+			break;
+		}
+	}
+	if (i == CONFIG_APP_SAMPLE_READERS_MAX) {
+		k_spin_unlock(&reader_lock, key);
+		LOG_ERR("No reader slot for %s", reader->name);
+		return -ENOMEM;
+	}
+
+	reader->cursor = (uint32_t)atomic_get(&ring.head);
+	reader->overruns = 0;
+	atomic_clear(&reader->wake_pending);
+	ring.readers[i] = reader;
+	/* Publishers trust every slot below the count, fill the slot first. */
+	barrier_dmem_fence_full();
+	if (i >= atomic_get(&ring.reader_count)) {
+		atomic_set(&ring.reader_count, i + 1);
+	}
+	k_spin_unlock(&reader_lock, key);
+	return 0;
+}
+
+void sample_reader_unregister(struct sample_reader *reader)
+{
+	k_spinlock_key_t key = k_spin_lock(&reader_lock);
+	int count = atomic_get(&ring.reader_count);
+
+	for (int i = 0; i < count; i++) {
+		if (ring.readers[i] == reader) {
+			ring.readers[i] = NULL;
+		}
+	}
+	while (count > 0 && ring.readers[count - 1] == NULL) {
+		count--;
+	}
+	atomic_set(&ring.reader_count, count);
+	k_spin_unlock(&reader_lock, key);
+}
+
+void sample_live_mute(bool mute)
+{
+	atomic_set(&live_muted, mute);
+}
+
+__app_itcm bool sample_live_muted(void)
+{
+	return atomic_get(&live_muted) != 0;
+}
+
+int sample_reader_wait(struct sample_reader *reader, k_timeout_t timeout)
+{
+	return k_sem_take(&reader->sem, timeout);
+}
+
+size_t sample_reader_drain(struct sample_reader *reader, sample_cb_t cb, void *user_data,
+			   size_t max)
+{
+	uint32_t head;
+	uint32_t overruns = reader->overruns;
+	size_t handled = 0;
+
+	/* Re-arm the wake-up before reading head so nothing published later is missed. */
+	atomic_clear(&reader->wake_pending);
+	head = (uint32_t)atomic_get(&ring.head);
+
+	if (head - reader->cursor > RING_SIZE) {
+		reader->overruns += head - reader->cursor - RING_SIZE;
+		reader->cursor = head - RING_SIZE;
+	}
+
+	while (handled < max && reader->cursor != head) {
+		const struct sample *sample = &ring.slot[reader->cursor & RING_MASK];
+		uint32_t expected = reader->cursor + 1;
+		uint32_t seq = *(volatile uint32_t *)&sample->seq;
+
+		if (seq != expected) {
+			if (seq != 0 && (int32_t)(seq - expected) > 0) {
+				/* Slot reused by a later lap, we were overtaken. */
+				reader->overruns++;
+				reader->cursor++;
+				continue;
+			}
+			/* Claimed but not published yet, keep ordering and stop here. */
+			break;
+		}
+
+		barrier_dmem_fence_full();
+		cb(sample, user_data);
+		barrier_dmem_fence_full();
+		if (*(volatile uint32_t *)&sample->seq != expected) {
+			/* Overwritten while the reader was looking at it. */
+			reader->overruns++;
+		}
+		reader->cursor++;
+		handled++;
+	}
+
+	if (reader->overruns != overruns) {
+		metric_add(&metric_sample_overrun, reader->overruns - overruns);
+	}
+	if (handled) {
+		metric_observe(&metric_sample_batch, handled);
+	}
+	return handled;
+}
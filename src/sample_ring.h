@@ -0,0 +1,102 @@
+#ifndef _SAMPLE_RING_H_
+#define _SAMPLE_RING_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+/*
+ * Single ring of tagged, cycle-stamped sensor samples shared by every
+ * producer (BLE notifications, IMU parser, loadcell, CAN RX) and followed by
+ * any number of readers, each with its own cursor.
+ *
+ * Producers claim a slot with one atomic increment, fill it in place and
+ * publish it by writing the slot's sequence number last; they never block
+ * and may run in ISRs. Readers are handed pointers into the ring, nothing is
+ * copied. A reader that falls more than the ring size behind loses the
+ * oldest samples and has them counted as overruns.
+ */
+
+enum sample_tag {
+	SAMPLE_FSR,
+	SAMPLE_CONTROLLER,
+	SAMPLE_IMU,
+	SAMPLE_LOADCELL,
+	SAMPLE_CAN,
+	SAMPLE_TAG_NUM,
+};
+
+struct fsr_data {
+	uint16_t value[4];
+};
+
+struct controller_data {
+	uint16_t value;
+	uint16_t mode;
+};
+
+#define SAMPLE_IMU_MAX_LEN 16
+
+struct sample {
+	uint32_t seq;		/* publication sequence + 1, 0 while being written */
+	uint32_t cycles;	/* k_cycle_get_32() when the source saw the data */
+	uint8_t tag;		/* enum sample_tag */
+	uint8_t src;		/* source instance, e.g. IMU index */
+	uint8_t len;		/* payload bytes used (IMU frame, CAN data) */
+	uint8_t trace;		/* latency_handle_t, 0 if not traced */
+	union {
+		struct fsr_data fsr;
+		struct controller_data controller;
+		uint16_t loadcell;
+		struct {
+			uint32_t id;
+			uint8_t data[8];
+		} can;
+		uint8_t imu[SAMPLE_IMU_MAX_LEN];
+	};
+};
+
+struct sample_reader {
+	const char *name;
+	uint32_t cursor;
+	uint32_t overruns;
+	/* Set by the first publish after a drain, so a batch wakes once. */
+	atomic_t wake_pending;
+	struct k_sem sem;
+};
+
+#define SAMPLE_READER_DEFINE(_name)                                            \
+	struct sample_reader _name = {                                         \
+		.name = #_name,                                                \
+		.sem = Z_SEM_INITIALIZER(_name.sem, 0, 1),                     \
+	}
+
+typedef void (*sample_cb_t)(const struct sample *sample, void *user_data);
+
+/* Reserve the next slot. The returned sample is invisible to readers until published. */
+struct sample *sample_claim(enum sample_tag tag, uint8_t src, uint32_t cycles);
+
+/* Make a claimed sample visible and wake each reader at most once per batch. */
+void sample_publish(struct sample *sample);
+
+/* Start following the ring from the newest sample; returns -ENOMEM if all reader slots are taken. */
+int sample_reader_register(struct sample_reader *reader);
+
+/* Stop following the ring and free the reader slot. */
+void sample_reader_unregister(struct sample_reader *reader);
+
+/*
+ * Mute the live sources (BLE notifications, loadcell, CAN RX, simulated
+ * feeders) while a session replay feeds the ring, so replayed and real
+ * samples do not mix. Live producers check sample_live_muted() first.
+ */
+void sample_live_mute(bool mute);
+bool sample_live_muted(void);
+
+/* Sleep until new samples may be available or timeout expires. */
+int sample_reader_wait(struct sample_reader *reader, k_timeout_t timeout);
+
+/* Hand up to max published samples to cb in order; returns the number handled. */
+size_t sample_reader_drain(struct sample_reader *reader, sample_cb_t cb, void *user_data,
+			   size_t max);
+
+#endif /* _SAMPLE_RING_H_ */
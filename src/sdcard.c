@@ -5,6 +5,8 @@
 #include <zephyr/fs/fs.h>
 #include <ff.h>
 
+#include "boot.h"
+
 LOG_MODULE_REGISTER(sdcard, LOG_LEVEL_INF);
 
 #define DISK_DRIVE_NAME "SD"
@@ -17,7 +19,7 @@ static struct fs_mount_t mp = {
 #define DISK_MOUNT_PT "/SD:"
 static const char *disk_mount_pt = DISK_MOUNT_PT;
 
-static int sdcard_init(void)
+static int sdcard_mount(void)
 {
     static const char *disk_pdrv = DISK_DRIVE_NAME;
     uint64_t memory_size_mb;
@@ -62,6 +64,23 @@ static int sdcard_init(void)
         LOG_ERR("Disk mount failed: %d", err);
     }
 
+	return err;
+}
+
+static void sdcard_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	boot_stage_begin(BOOT_SDCARD);
+	boot_stage_end(BOOT_SDCARD, sdcard_mount());
+}
+
+static K_WORK_DEFINE(sdcard_work, sdcard_work_handler);
+
+static int sdcard_init(void)
+{
+	/* Mounting takes a while, let it overlap with the Bluetooth start. */
+	boot_defer(&sdcard_work);
 	return 0;
 }
 
@@ -0,0 +1,504 @@
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample_ring.h"
+#include "uart_imu.h"
+#include "motor_can.h"
+#include "latency.h"
+#include "metrics.h"
+
+LOG_MODULE_REGISTER(session, LOG_LEVEL_INF);
+
+/*
+ * Session recording and replay. Recording follows the sample ring and
+ * writes every sample to a file. Replay reads such a file back and feeds
+ * each record to the pipeline where its live source would: FSR, controller,
+ * loadcell and CAN RX samples are published to the sample ring, IMU frames
+ * go into the IMU RX rings behind the ISR. Meanwhile the periodic drive
+ * frame the CAN actor produces is captured into an output file instead of
+ * being sent, so a replay never drives the motors. Its periods are counted
+ * on the recording's clock, so captures of one recording line up at any
+ * speed.
+ *
+ * File layout: the magic "RBS1", then records of a little endian u32
+ * microseconds since the previous record, tag, source and payload length
+ * bytes, and the payload. FSR is four u16, controller value and mode u16,
+ * loadcell one u16, IMU the raw frame, CAN a u32 id and the data. Captured
+ * drive frames are written in the same format with source 1.
+ */
+
+#define SESSION_MAGIC "RBS1"
+#define SESSION_MAGIC_LEN 4
+#define RECORD_HDR_LEN 7
+#define RECORD_MAX_LEN (RECORD_HDR_LEN + 4 + 16)
+#define WRITE_BUF_SIZE 512
+#define SAMPLE_BATCH 16
+/* Longer gaps are timed with the uptime, the cycle counter may have wrapped. */
+#define LONG_GAP_MS 1000
+#define CAN_SRC_TX 1
+#define CAN_PERIOD_US (CONFIG_APP_CAN_TX_PERIOD_MS * USEC_PER_MSEC)
+/* Records fed as fast as possible between two one-tick sleeps. */
+#define REPLAY_BURST 32
+
+enum session_mode {
+	SESSION_IDLE,
+	SESSION_RECORD,
+	SESSION_REPLAY,
+};
+
+static const char *const mode_names[] = { "idle", "recording", "replaying" };
+
+static const struct device *const imu_uarts[] = {
+	DEVICE_DT_GET(DT_ALIAS(imu0)),
+	DEVICE_DT_GET(DT_ALIAS(imu1)),
+};
+
+struct captured_frame {
+	uint64_t t_us;
+	uint32_t id;
+	uint8_t len;
+	uint8_t data[8];
+};
+
+K_MSGQ_DEFINE(capture_msgq, sizeof(struct captured_frame), CONFIG_APP_SESSION_CAPTURE_DEPTH, 8);
+static SAMPLE_READER_DEFINE(session_reader);
+static K_SEM_DEFINE(session_start, 0, 1);
+
+METRIC_COUNTER_DEFINE(metric_session_capture_drop, "session.capture_drop");
+
+static struct {
+	enum session_mode mode;
+	bool stop;
+	uint32_t speed;
+	char path[CONFIG_APP_SESSION_PATH_LEN];
+	char out_path[CONFIG_APP_SESSION_PATH_LEN];
+	struct fs_file_t file;
+	struct fs_file_t out;
+	uint8_t buf[WRITE_BUF_SIZE];
+	size_t buf_len;
+	uint32_t records;
+	uint32_t captured;
+	uint32_t last_cycles;
+	int64_t last_ms;
+	/* Recording time of the drive frame period due, and of the last one written. */
+	uint64_t tick_us;
+	uint64_t captured_us;
+	int err;
+} session;
+
+/* Records are buffered so the card sees sector sized writes. */
+static void put_record(struct fs_file_t *file, uint32_t dt_us, const struct sample *sample,
+		       const uint8_t *payload, uint8_t len)
+{
+	uint8_t *p;
+
+	if (session.buf_len + RECORD_HDR_LEN + len > sizeof(session.buf)) {
+		if (fs_write(file, session.buf, session.buf_len) != (ssize_t)session.buf_len) {
+			session.err = -EIO;
+		}
+		session.buf_len = 0;
+	}
+	p = &session.buf[session.buf_len];
+	sys_put_le32(dt_us, p);
+	p[4] = sample->tag;
+	p[5] = sample->src;
+	p[6] = len;
+	memcpy(&p[RECORD_HDR_LEN], payload, len);
+	session.buf_len += RECORD_HDR_LEN + len;
+}
+
+static void flush_records(struct fs_file_t *file)
+{
+	if (session.buf_len &&
+	    fs_write(file, session.buf, session.buf_len) != (ssize_t)session.buf_len) {
+		session.err = -EIO;
+	}
+	session.buf_len = 0;
+}
+
+static uint8_t encode_payload(const struct sample *sample, uint8_t *payload)
+{
+	switch (sample->tag) {
+	case SAMPLE_FSR:
+		for (int i = 0; i < ARRAY_SIZE(sample->fsr.value); i++) {
+			sys_put_le16(sample->fsr.value[i], &payload[2 * i]);
+		}
+		return sizeof(sample->fsr);
+	case SAMPLE_CONTROLLER:
+		sys_put_le16(sample->controller.value, payload);
+		sys_put_le16(sample->controller.mode, &payload[2]);
+		return sizeof(sample->controller);
+	case SAMPLE_LOADCELL:
+		sys_put_le16(sample->loadcell, payload);
+		return sizeof(sample->loadcell);
+	case SAMPLE_IMU:
+		memcpy(payload, sample->imu, sample->len);
+		return sample->len;
+	case SAMPLE_CAN:
+		sys_put_le32(sample->can.id, payload);
+		memcpy(&payload[4], sample->can.data, sample->len);
+		return 4 + sample->len;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t elapsed_us(uint32_t cycles)
+{
+	int64_t now = k_uptime_get();
+	uint32_t dt_us;
+
+	if (now - session.last_ms > LONG_GAP_MS) {
+		dt_us = (uint32_t)(now - session.last_ms) * USEC_PER_MSEC;
+	} else {
+		dt_us = k_cyc_to_us_floor32(cycles - session.last_cycles);
+	}
+	session.last_cycles = cycles;
+	session.last_ms = now;
+	return dt_us;
+}
+
+static void record_sample(const struct sample *sample, void *user_data)
+{
+	uint8_t payload[RECORD_MAX_LEN];
+	uint8_t len = encode_payload(sample, payload);
+
+	ARG_UNUSED(user_data);
+
+	put_record(&session.file, elapsed_us(sample->cycles), sample, payload, len);
+	session.records++;
+}
+
+static void record(void)
+{
+	session.last_cycles = k_cycle_get_32();
+	session.last_ms = k_uptime_get();
+	/* Registering starts from now, not from whatever the ring still holds. */
+	session.err = sample_reader_register(&session_reader);
+	if (session.err) {
+		return;
+	}
+
+	while (!session.stop && !session.err) {
+		sample_reader_wait(&session_reader, K_MSEC(100));
+		while (sample_reader_drain(&session_reader, record_sample, NULL, SAMPLE_BATCH)) {
+		}
+	}
+	sample_reader_unregister(&session_reader);
+	flush_records(&session.file);
+}
+
+static void capture_frame(const struct can_frame *frame)
+{
+	struct captured_frame c = {
+		/* Set before can_capture_tick() posted the period we run for. */
+		.t_us = session.tick_us,
+		.id = frame->id,
+		.len = MIN(can_dlc_to_bytes(frame->dlc), sizeof(c.data)),
+	};
+
+	memcpy(c.data, frame->data, c.len);
+	if (k_msgq_put(&capture_msgq, &c, K_NO_WAIT)) {
+		metric_inc(&metric_session_capture_drop);
+	}
+}
+
+static void write_captured(void)
+{
+	struct captured_frame c;
+	struct sample s = { .tag = SAMPLE_CAN, .src = CAN_SRC_TX };
+	uint8_t payload[4 + sizeof(c.data)];
+
+	while (k_msgq_get(&capture_msgq, &c, K_NO_WAIT) == 0) {
+		sys_put_le32(c.id, payload);
+		memcpy(&payload[4], c.data, c.len);
+		put_record(&session.out, (uint32_t)(c.t_us - session.captured_us), &s, payload,
+			   4 + c.len);
+		session.captured_us = c.t_us;
+		session.captured++;
+	}
+}
+
+static void inject(uint8_t tag, uint8_t src, const uint8_t *payload, uint8_t len)
+{
+	uint32_t now = k_cycle_get_32();
+	struct sample *sample;
+
+	if (tag == SAMPLE_IMU) {
+		if (src < ARRAY_SIZE(imu_uarts)) {
+			uart_imu_inject(src, payload, len);
+		}
+		return;
+	}
+	if (tag >= SAMPLE_TAG_NUM) {
+		return;
+	}
+
+	sample = sample_claim(tag, src, now);
+	switch (tag) {
+	case SAMPLE_FSR:
+		for (int i = 0; i < ARRAY_SIZE(sample->fsr.value); i++) {
+			sample->fsr.value[i] = sys_get_le16(&payload[2 * i]);
+		}
+		sample->trace = latency_start(LATENCY_FSR_MONITOR, now);
+		break;
+	case SAMPLE_CONTROLLER:
+		sample->controller.value = sys_get_le16(payload);
+		sample->controller.mode = sys_get_le16(&payload[2]);
+		sample->trace = latency_start(LATENCY_CONTROLLER_MONITOR, now);
+		break;
+	case SAMPLE_LOADCELL:
+		sample->loadcell = sys_get_le16(payload);
+		break;
+	case SAMPLE_CAN:
+		sample->can.id = sys_get_le32(payload);
+		memcpy(sample->can.data, &payload[4], MIN(len - 4, sizeof(sample->can.data)));
+		break;
+	}
+	sample->len = tag == SAMPLE_CAN ? len - 4 : len;
+	latency_stamp(sample->trace, LATENCY_QUEUE);
+	sample_publish(sample);
+}
+
+static bool valid_len(uint8_t tag, uint8_t len)
+{
+	switch (tag) {
+	case SAMPLE_FSR:
+		return len == sizeof(struct fsr_data);
+	case SAMPLE_CONTROLLER:
+		return len == sizeof(struct controller_data);
+	case SAMPLE_LOADCELL:
+		return len == sizeof(uint16_t);
+	case SAMPLE_IMU:
+		return len <= SAMPLE_IMU_MAX_LEN;
+	case SAMPLE_CAN:
+		return len >= 4 && len <= 4 + 8;
+	default:
+		return false;
+	}
+}
+
+/* Wait until recording time t_us is due at the replay speed. */
+static void replay_wait(int64_t start, uint64_t t_us)
+{
+	if (session.speed) {
+		k_sleep(K_TIMEOUT_ABS_TICKS(start + k_us_to_ticks_ceil64(t_us / session.speed)));
+	}
+}
+
+static void replay(void)
+{
+	uint8_t hdr[RECORD_HDR_LEN];
+	uint8_t payload[RECORD_MAX_LEN];
+	int64_t start = k_uptime_ticks();
+	uint64_t t_us = 0;
+	uint64_t tx_us = CAN_PERIOD_US;
+	ssize_t ret;
+
+	session.tick_us = 0;
+	session.captured_us = 0;
+	k_msgq_purge(&capture_msgq);
+	for (int i = 0; i < ARRAY_SIZE(imu_uarts); i++) {
+		session.err = uart_imu_inject_begin(i);
+		if (session.err) {
+			LOG_ERR("imu%d is busy (err %d)", i, session.err);
+			while (i--) {
+				uart_imu_inject_end(i);
+			}
+			return;
+		}
+	}
+	can_capture_set(capture_frame);
+	sample_live_mute(true);
+
+	while (!session.stop) {
+		ret = fs_read(&session.file, hdr, sizeof(hdr));
+		if (ret != sizeof(hdr)) {
+			break;
+		}
+		if (!valid_len(hdr[4], hdr[6]) ||
+		    fs_read(&session.file, payload, hdr[6]) != hdr[6]) {
+			LOG_ERR("Bad record %u", session.records);
+			session.err = -EBADMSG;
+			break;
+		}
+		t_us += sys_get_le32(hdr);
+		while (tx_us <= t_us) {
+			replay_wait(start, tx_us);
+			session.tick_us = tx_us;
+			can_capture_tick();
+			write_captured();
+			tx_us += CAN_PERIOD_US;
+		}
+		if (session.speed) {
+			replay_wait(start, t_us);
+		} else if (session.records % REPLAY_BURST == REPLAY_BURST - 1) {
+			/* Yielding alone would starve the shell and the idle thread. */
+			k_sleep(K_TICKS(1));
+		} else {
+			k_yield();
+		}
+		inject(hdr[4], hdr[5], payload, hdr[6]);
+		session.records++;
+		write_captured();
+	}
+
+	/* Let the pipeline finish the last records before letting go of CAN. */
+	k_msleep(CONFIG_APP_SESSION_SETTLE_MS);
+	sample_live_mute(false);
+	can_capture_set(NULL);
+	write_captured();
+	flush_records(&session.out);
+	for (int i = 0; i < ARRAY_SIZE(imu_uarts); i++) {
+		uart_imu_inject_end(i);
+	}
+}
+
+static int open_file(struct fs_file_t *file, const char *path, fs_mode_t flags)
+{
+	int err;
+
+	fs_file_t_init(file);
+	if (flags & FS_O_CREATE) {
+		fs_unlink(path);
+	}
+	err = fs_open(file, path, flags);
+	if (err) {
+		LOG_ERR("Cannot open %s (err %d)", path, err);
+	}
+	return err;
+}
+
+static void session_run(void *p1, void *p2, void *p3)
+{
+	char magic[SESSION_MAGIC_LEN];
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&session_start, K_FOREVER);
+
+		if (session.mode == SESSION_RECORD) {
+			session.err = open_file(&session.file, session.path,
+						FS_O_CREATE | FS_O_WRITE);
+			if (!session.err) {
+				fs_write(&session.file, SESSION_MAGIC, SESSION_MAGIC_LEN);
+				record();
+				fs_close(&session.file);
+			}
+		} else {
+			session.err = open_file(&session.file, session.path, FS_O_READ);
+			if (!session.err && (fs_read(&session.file, magic, sizeof(magic)) !=
+						     sizeof(magic) ||
+					     memcmp(magic, SESSION_MAGIC, sizeof(magic)))) {
+				LOG_ERR("%s is not a session file", session.path);
+				session.err = -EBADMSG;
+			}
+			if (!session.err) {
+				session.err = open_file(&session.out, session.out_path,
+							FS_O_CREATE | FS_O_WRITE);
+			}
+			if (!session.err) {
+				fs_write(&session.out, SESSION_MAGIC, SESSION_MAGIC_LEN);
+				replay();
+				fs_close(&session.out);
+			}
+			fs_close(&session.file);
+		}
+
+		LOG_INF("Session %s done: %u records, %u drive frames captured (err %d)",
+			session.path, session.records, session.captured, session.err);
+		session.mode = SESSION_IDLE;
+	}
+}
+
+K_THREAD_DEFINE(session_thread, CONFIG_APP_SESSION_STACK_SIZE, session_run, NULL, NULL, NULL,
+		CONFIG_APP_SESSION_PRIORITY, 0, 0);
+
+static int start(const struct shell *sh, enum session_mode mode, const char *path)
+{
+	if (session.mode != SESSION_IDLE) {
+		shell_error(sh, "session busy %s %s", mode_names[session.mode], session.path);
+		return -EBUSY;
+	}
+	if (strlen(path) >= sizeof(session.path)) {
+		shell_error(sh, "path too long");
+		return -ENAMETOOLONG;
+	}
+	strcpy(session.path, path);
+	session.records = 0;
+	session.captured = 0;
+	session.buf_len = 0;
+	session.err = 0;
+	session.stop = false;
+	session.mode = mode;
+	k_sem_give(&session_start);
+	return 0;
+}
+
+static int cmd_session_record(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+
+	return start(sh, SESSION_RECORD, argv[1]);
+}
+
+static int cmd_session_replay(const struct shell *sh, size_t argc, char *argv[])
+{
+	const char *out = argc > 3 ? argv[3] : CONFIG_APP_SESSION_CAPTURE_FILE;
+
+	if (session.mode != SESSION_IDLE) {
+		shell_error(sh, "session busy %s %s", mode_names[session.mode], session.path);
+		return -EBUSY;
+	}
+	if (strlen(out) >= sizeof(session.out_path)) {
+		shell_error(sh, "path too long");
+		return -ENAMETOOLONG;
+	}
+	strcpy(session.out_path, out);
+	session.speed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+	return start(sh, SESSION_REPLAY, argv[1]);
+}
+
+static int cmd_session_stop(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	session.stop = true;
+	return 0;
+}
+
+static int cmd_session_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%s %s: %u records, %u drive frames captured, err %d",
+		    mode_names[session.mode], session.path, session.records, session.captured,
+		    session.err);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(session_subcmd,
+	SHELL_CMD_ARG(record, NULL, "<file>\n\nRecord all sensor samples to a file",
+		      cmd_session_record, 2, 0),
+	SHELL_CMD_ARG(replay, NULL,
+		      "<file> [speed] [capture_file]\n\n"
+		      "Feed a recording to the pipeline at speed x real time (0 as fast as "
+		      "possible) and capture the drive frames instead of sending them",
+		      cmd_session_replay, 2, 2),
+	SHELL_CMD(show, NULL, "Session state and counts", cmd_session_show),
+	SHELL_CMD(stop, NULL, "Stop recording or replay", cmd_session_stop),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(session, &session_subcmd, "Record and replay sensor sessions", NULL);
@@ -0,0 +1,216 @@
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/adc/adc_emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample_ring.h"
+#include "uart_imu.h"
+#include "latency.h"
+
+LOG_MODULE_REGISTER(sim, LOG_LEVEL_INF);
+
+/*
+ * Sensor stand-ins for host builds. A feeder thread writes IMU frames into
+ * the emulated UARTs and, with no BLE sensor around, publishes FSR samples
+ * straight into the sample ring. The loadcell ADC returns a slow triangle
+ * wave and buttons can be pressed from the shell.
+ */
+
+#define IMU_FRAME_SYNC CONFIG_APP_IMU_FRAME_SYNC
+#define IMU_FRAME_LEN CONFIG_APP_IMU_FRAME_LEN
+#define SIM_TICK_MS 1
+#define LOADCELL_PERIOD_MS 10000
+#define LOADCELL_MAX_MV 3000
+
+static const struct device *const imu_uarts[] = {
+	DEVICE_DT_GET(DT_ALIAS(imu0)),
+	DEVICE_DT_GET(DT_ALIAS(imu1)),
+};
+
+static const struct adc_dt_spec loadcell =
+	ADC_DT_SPEC_GET_BY_NAME(DT_PATH(zephyr_user), loadcell);
+
+static const struct gpio_dt_spec buttons[] = {
+	GPIO_DT_SPEC_GET(DT_ALIAS(sw0), gpios),
+	GPIO_DT_SPEC_GET(DT_ALIAS(sw1), gpios),
+};
+
+static struct {
+	uint32_t imu_rate_hz;
+	uint32_t fsr_rate_hz;
+	uint32_t imu_acc;
+	uint32_t fsr_acc;
+	uint32_t imu_frames;
+	uint32_t fsr_samples;
+} sim = {
+	.imu_rate_hz = CONFIG_APP_SIM_IMU_RATE_HZ,
+	.fsr_rate_hz = CONFIG_APP_SIM_FSR_RATE_HZ,
+};
+
+static void feed_imu(uint32_t n)
+{
+	uint8_t frame[IMU_FRAME_LEN];
+	uint8_t sum = 0;
+
+	if (sample_live_muted()) {
+		return;
+	}
+	frame[0] = IMU_FRAME_SYNC;
+	/* Cycle through acceleration, angular rate and angle frames. */
+	frame[1] = 0x51 + n % 3;
+	for (int i = 2; i < IMU_FRAME_LEN - 1; i++) {
+		frame[i] = (uint8_t)(n * (i + 1));
+	}
+	for (int i = 0; i < IMU_FRAME_LEN - 1; i++) {
+		sum += frame[i];
+	}
+	frame[IMU_FRAME_LEN - 1] = sum;
+
+	for (int i = 0; i < ARRAY_SIZE(imu_uarts); i++) {
+		/* A replay feeding this input has it to itself. */
+		if (!uart_imu_owned(i)) {
+			uart_emul_put_rx_data(imu_uarts[i], frame, sizeof(frame));
+		}
+	}
+}
+
+static void feed_fsr(uint32_t n)
+{
+	uint32_t rx = k_cycle_get_32();
+	struct sample *sample;
+
+	if (sample_live_muted()) {
+		return;
+	}
+	sample = sample_claim(SAMPLE_FSR, 0, rx);
+
+	for (int i = 0; i < ARRAY_SIZE(sample->fsr.value); i++) {
+		sample->fsr.value[i] = (uint16_t)((n * 16 + i * 1000) % 4096);
+	}
+	sample->len = sizeof(sample->fsr);
+	sample->trace = latency_start(LATENCY_FSR_MONITOR, rx);
+	latency_stamp(sample->trace, LATENCY_QUEUE);
+	sample_publish(sample);
+}
+
+/* Spread rate_hz events evenly over the 1 kHz feeder tick. */
+static uint32_t due(uint32_t *acc, uint32_t rate_hz)
+{
+	uint32_t n;
+
+	*acc += rate_hz * SIM_TICK_MS;
+	n = *acc / MSEC_PER_SEC;
+	*acc %= MSEC_PER_SEC;
+	return n;
+}
+
+static void sim_run(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		for (uint32_t n = due(&sim.imu_acc, sim.imu_rate_hz); n; n--) {
+			feed_imu(sim.imu_frames++);
+		}
+		for (uint32_t n = due(&sim.fsr_acc, sim.fsr_rate_hz); n; n--) {
+			feed_fsr(sim.fsr_samples++);
+		}
+		k_msleep(SIM_TICK_MS);
+	}
+}
+
+K_THREAD_DEFINE(sim_thread, 1024, sim_run, NULL, NULL, NULL, 2, 0, 0);
+
+static int loadcell_value(const struct device *dev, unsigned int chan, void *data,
+			  uint32_t *result)
+{
+	uint32_t t = k_uptime_get_32() % LOADCELL_PERIOD_MS;
+	uint32_t half = LOADCELL_PERIOD_MS / 2;
+
+	ARG_UNUSED(dev);
+	ARG_UNUSED(chan);
+	ARG_UNUSED(data);
+
+	*result = (t < half ? t : LOADCELL_PERIOD_MS - t) * LOADCELL_MAX_MV / half;
+	return 0;
+}
+
+static int sim_init(void)
+{
+	int err;
+
+	err = adc_emul_value_func_set(loadcell.dev, loadcell.channel_id, loadcell_value, NULL);
+	if (err) {
+		LOG_ERR("Loadcell emulator setup failed (err %d)", err);
+	}
+	return 0;
+}
+
+SYS_INIT(sim_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static int cmd_sim_rate(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t *rate;
+
+	if (strcmp(argv[1], "imu") == 0) {
+		rate = &sim.imu_rate_hz;
+	} else if (strcmp(argv[1], "fsr") == 0) {
+		rate = &sim.fsr_rate_hz;
+	} else {
+		shell_error(sh, "unknown source %s", argv[1]);
+		return -EINVAL;
+	}
+	if (argc > 2) {
+		*rate = MIN(strtoul(argv[2], NULL, 0), MSEC_PER_SEC * 10);
+	}
+	shell_print(sh, "%s: %u Hz", argv[1], *rate);
+	return 0;
+}
+
+static int cmd_sim_button(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint32_t index = strtoul(argv[1], NULL, 0);
+	uint32_t hold_ms = argc > 2 ? strtoul(argv[2], NULL, 0) : 100;
+	const struct gpio_dt_spec *button;
+
+	if (index >= ARRAY_SIZE(buttons)) {
+		shell_error(sh, "no button %u", index);
+		return -EINVAL;
+	}
+	button = &buttons[index];
+	gpio_emul_input_set(button->port, button->pin, 1);
+	k_msleep(hold_ms);
+	gpio_emul_input_set(button->port, button->pin, 0);
+	shell_print(sh, "button %u pressed for %u ms", index, hold_ms);
+	return 0;
+}
+
+static int cmd_sim_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "imu: %u Hz, %u frames per UART", sim.imu_rate_hz, sim.imu_frames);
+	shell_print(sh, "fsr: %u Hz, %u samples", sim.fsr_rate_hz, sim.fsr_samples);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sim_subcmd,
+	SHELL_CMD_ARG(button, NULL, "<0|1> [hold_ms]\n\nPress an emulated button",
+		      cmd_sim_button, 2, 1),
+	SHELL_CMD_ARG(rate, NULL, "<imu|fsr> [hz]\n\nGet or set a feeder rate", cmd_sim_rate,
+		      2, 1),
+	SHELL_CMD(show, NULL, "Feeder rates and counts", cmd_sim_show),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(sim, &sim_subcmd, "Simulated sensors", NULL);
@@ -0,0 +1,291 @@
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/random/random.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(storage_bench, LOG_LEVEL_INF);
+
+/*
+ * File system benchmark. Each mount gets one scratch file that is written
+ * sequentially (appending to an empty file, and again into a file
+ * preallocated with fs_truncate()), read back, then written and read at
+ * random block offsets. Throughput includes the closing fs_sync(), which is
+ * also reported on its own; every single operation is timed and kept so p99
+ * and worst case come from the exact samples. Results are kept until the end so saving them does not
+ * disturb the runs.
+ */
+
+#define BENCH_FILE "storage_bench.bin"
+#define BENCH_BLOCK_MAX 4096
+#define BENCH_RESULTS_MAX 32
+/* One sample per block of the smallest size, so this bounds the pass size */
+#define BENCH_OPS_MAX 4096
+
+static const char *const mounts[] = {
+	"/SD:",
+#if DT_NODE_EXISTS(DT_NODELABEL(lfs1))
+	DT_PROP(DT_NODELABEL(lfs1), mount_point),
+#endif
+};
+
+static const uint16_t block_sizes[] = { 256, 1024, BENCH_BLOCK_MAX };
+
+#define BENCH_SIZE_MAX (BENCH_OPS_MAX * 256)
+
+BUILD_ASSERT(CONFIG_APP_STORAGE_BENCH_SIZE_KB * 1024 <= BENCH_SIZE_MAX,
+	     "default pass size needs more samples than BENCH_OPS_MAX");
+
+enum bench_pass {
+	PASS_SEQ_WRITE,
+	PASS_SEQ_READ,
+	PASS_PREALLOC_WRITE,
+	PASS_RAND_WRITE,
+	PASS_RAND_READ,
+	PASS_NUM,
+};
+
+static const char *const pass_names[] = {
+	[PASS_SEQ_WRITE] = "seq_write",
+	[PASS_SEQ_READ] = "seq_read",
+	[PASS_PREALLOC_WRITE] = "prealloc_write",
+	[PASS_RAND_WRITE] = "rand_write",
+	[PASS_RAND_READ] = "rand_read",
+};
+
+struct bench_result {
+	const char *mount;
+	uint16_t block;
+	uint8_t pass;
+	uint32_t kbps;
+	uint32_t p99_us;
+	uint32_t max_us;
+	uint32_t sync_us;
+};
+
+static uint8_t block_buf[BENCH_BLOCK_MAX] __aligned(4);
+static uint32_t op_us[BENCH_OPS_MAX];
+static struct bench_result results[BENCH_RESULTS_MAX];
+static size_t result_count;
+
+static bool is_write(enum bench_pass pass)
+{
+	return pass != PASS_SEQ_READ && pass != PASS_RAND_READ;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank: the smallest sample with at least percent of them at or below it. */
+static uint32_t ops_percentile(uint32_t n, uint32_t percent)
+{
+	return op_us[MAX(DIV_ROUND_UP(n * percent, 100), 1) - 1];
+}
+
+static int run_pass(const char *path, enum bench_pass pass, size_t block, size_t total,
+		    struct bench_result *r)
+{
+	bool write = is_write(pass);
+	bool random = pass == PASS_RAND_WRITE || pass == PASS_RAND_READ;
+	uint32_t blocks = total / block;
+	struct fs_file_t file;
+	int64_t start, elapsed;
+	uint32_t t;
+	ssize_t ret;
+	int err;
+
+	if (pass == PASS_SEQ_WRITE || pass == PASS_PREALLOC_WRITE) {
+		fs_unlink(path);
+	}
+	fs_file_t_init(&file);
+	err = fs_open(&file, path, write ? FS_O_CREATE | FS_O_RDWR : FS_O_READ);
+	if (err) {
+		return err;
+	}
+	if (pass == PASS_PREALLOC_WRITE) {
+		err = fs_truncate(&file, total);
+		if (!err) {
+			err = fs_sync(&file);
+		}
+	}
+
+	start = k_uptime_ticks();
+	for (uint32_t i = 0; i < blocks && !err; i++) {
+		if (random) {
+			err = fs_seek(&file, (off_t)(sys_rand32_get() % blocks) * block,
+				      FS_SEEK_SET);
+			if (err) {
+				break;
+			}
+		}
+		t = k_cycle_get_32();
+		ret = write ? fs_write(&file, block_buf, block) : fs_read(&file, block_buf, block);
+		op_us[i] = k_cyc_to_us_floor32(k_cycle_get_32() - t);
+		if (ret != (ssize_t)block) {
+			err = ret < 0 ? ret : -EIO;
+		}
+	}
+	if (!err && write) {
+		t = k_cycle_get_32();
+		err = fs_sync(&file);
+		r->sync_us = k_cyc_to_us_floor32(k_cycle_get_32() - t);
+	}
+	elapsed = k_uptime_ticks() - start;
+	fs_close(&file);
+	if (err) {
+		return err;
+	}
+
+	r->kbps = (uint32_t)((uint64_t)blocks * block * USEC_PER_SEC / 1024 /
+			     MAX(k_ticks_to_us_floor64(elapsed), 1));
+	qsort(op_us, blocks, sizeof(op_us[0]), cmp_u32);
+	r->p99_us = ops_percentile(blocks, 99);
+	r->max_us = op_us[blocks - 1];
+	return 0;
+}
+
+static int bench_mount(const struct shell *sh, const char *mount, size_t total)
+{
+	char path[32];
+	struct bench_result *r;
+	int err = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", mount, BENCH_FILE);
+	for (int b = 0; b < ARRAY_SIZE(block_sizes) && !err; b++) {
+		for (int pass = 0; pass < PASS_NUM; pass++) {
+			if (result_count == ARRAY_SIZE(results)) {
+				break;
+			}
+			r = &results[result_count];
+			*r = (struct bench_result){
+				.mount = mount,
+				.block = block_sizes[b],
+				.pass = pass,
+			};
+			err = run_pass(path, pass, block_sizes[b], total, r);
+			if (err) {
+				shell_error(sh, "%s: %s with %u byte blocks failed (err %d)", mount,
+					    pass_names[pass], block_sizes[b], err);
+				break;
+			}
+			result_count++;
+		}
+	}
+	fs_unlink(path);
+	return err;
+}
+
+static void print_results(const struct shell *sh)
+{
+	const struct bench_result *r;
+
+	shell_print(sh, "%-6s %6s %-15s %8s %8s %8s %8s", "mount", "block", "test", "KiB/s",
+		    "p99 us", "max us", "sync us");
+	for (size_t i = 0; i < result_count; i++) {
+		r = &results[i];
+		if (is_write(r->pass)) {
+			shell_print(sh, "%-6s %6u %-15s %8u %8u %8u %8u", r->mount, r->block,
+				    pass_names[r->pass], r->kbps, r->p99_us, r->max_us,
+				    r->sync_us);
+		} else {
+			shell_print(sh, "%-6s %6u %-15s %8u %8u %8u %8s", r->mount, r->block,
+				    pass_names[r->pass], r->kbps, r->p99_us, r->max_us, "-");
+		}
+	}
+}
+
+/* Append to a CSV file, one line per result, tagged with the uptime of the run. */
+static int save_results(const char *path)
+{
+	struct fs_file_t file;
+	struct fs_dirent entry;
+	const struct bench_result *r;
+	uint32_t run = k_uptime_get_32();
+	bool header = fs_stat(path, &entry) != 0 || entry.size == 0;
+	char line[96];
+	int len;
+	int err;
+
+	fs_file_t_init(&file);
+	err = fs_open(&file, path, FS_O_CREATE | FS_O_WRITE | FS_O_APPEND);
+	if (err) {
+		return err;
+	}
+	if (header) {
+		len = snprintf(line, sizeof(line),
+			       "run_ms,mount,block,test,kib_s,p99_us,max_us,sync_us\n");
+		fs_write(&file, line, len);
+	}
+	for (size_t i = 0; i < result_count; i++) {
+		r = &results[i];
+		len = snprintf(line, sizeof(line), "%u,%s,%u,%s,%u,%u,%u,%u\n", run, r->mount,
+			       r->block, pass_names[r->pass], r->kbps, r->p99_us, r->max_us,
+			       r->sync_us);
+		if (fs_write(&file, line, len) != len) {
+			err = -EIO;
+			break;
+		}
+	}
+	fs_close(&file);
+	return err;
+}
+
+static int cmd_storage_bench(const struct shell *sh, size_t argc, char *argv[])
+{
+	size_t total = CONFIG_APP_STORAGE_BENCH_SIZE_KB * 1024;
+	int err = 0;
+
+	if (argc > 2) {
+		total = strtoul(argv[2], NULL, 0) * 1024;
+		if (total < BENCH_BLOCK_MAX || total > BENCH_SIZE_MAX) {
+			shell_error(sh, "size must be %u to %u KiB", BENCH_BLOCK_MAX / 1024,
+				    BENCH_SIZE_MAX / 1024);
+			return -EINVAL;
+		}
+	}
+	for (size_t i = 0; i < sizeof(block_buf); i++) {
+		block_buf[i] = (uint8_t)i;
+	}
+
+	result_count = 0;
+	for (int i = 0; i < ARRAY_SIZE(mounts); i++) {
+		if (argc > 1 && strcmp(argv[1], mounts[i]) != 0) {
+			continue;
+		}
+		shell_print(sh, "%s: %zu KiB per pass...", mounts[i], total / 1024);
+		if (bench_mount(sh, mounts[i], total)) {
+			err = -EIO;
+		}
+	}
+	if (result_count == 0) {
+		shell_error(sh, "no results");
+		return err ? err : -ENOENT;
+	}
+
+	print_results(sh);
+	if (save_results(CONFIG_APP_STORAGE_BENCH_RESULTS)) {
+		shell_warn(sh, "could not save results to %s", CONFIG_APP_STORAGE_BENCH_RESULTS);
+	} else {
+		shell_print(sh, "results appended to %s", CONFIG_APP_STORAGE_BENCH_RESULTS);
+	}
+	return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(storage_subcmd,
+	SHELL_CMD_ARG(bench, NULL,
+		      "[mount] [size_kb]\n\n"
+		      "Sequential, preallocated and random write/read throughput, fsync "
+		      "cost and write latency per mount",
+		      cmd_storage_bench, 1, 2),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(storage, &storage_subcmd, "Storage tools", NULL);
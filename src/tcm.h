@@ -0,0 +1,33 @@
+#ifndef _TCM_H_
+#define _TCM_H_
+
+#include <zephyr/linker/section_tags.h>
+
+/*
+ * Placement of hot code and data in the Cortex-M7 tightly-coupled memories.
+ * ITCM and DTCM are zero wait state, unlike flash behind the ART cache and
+ * AXI SRAM behind the D-cache. Code tagged __app_itcm is copied from flash to
+ * ITCM at boot. DTCM is not reachable by the general purpose DMA engines, so
+ * never place DMA buffers there.
+ *
+ * Without CONFIG_APP_ITCM / CONFIG_APP_DTCM the macros expand to nothing and
+ * everything stays in the default sections.
+ */
+
+#ifdef CONFIG_APP_ITCM
+#define __app_itcm		__itcm_section
+#else
+#define __app_itcm
+#endif
+
+#ifdef CONFIG_APP_DTCM
+#define __app_dtcm_data		__dtcm_data_section
+#define __app_dtcm_bss		__dtcm_bss_section
+#define __app_dtcm_noinit	__dtcm_noinit_section
+#else
+#define __app_dtcm_data
+#define __app_dtcm_bss
+#define __app_dtcm_noinit	__noinit
+#endif
+
+#endif /* _TCM_H_ */
@@ -0,0 +1,269 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "actor.h"
+#include "thmon.h"
+
+LOG_MODULE_REGISTER(thmon, LOG_LEVEL_INF);
+
+#define MAX_THREADS CONFIG_APP_THMON_MAX_THREADS
+
+enum thmon_flag {
+	FLAG_SAMPLE,
+	FLAG_NUM,
+};
+
+struct thread_load {
+	const struct k_thread *thread;
+	uint64_t cycles;		/* execution cycles at the previous sample */
+	uint32_t windows;		/* times scheduled in at the previous sample */
+	uint16_t cpu;			/* 0.01 % of the last period */
+	uint16_t switches;		/* scheduled in during the last period */
+	size_t stack_size;
+	size_t stack_used;
+	bool baseline;			/* cycles and windows hold a previous sample */
+	bool seen;
+	bool over_cpu;
+	bool over_stack;
+};
+
+static struct {
+	struct thread_load load[MAX_THREADS];
+	uint64_t total;			/* all-thread execution cycles at the previous sample */
+	uint64_t idle;
+	uint16_t idle_cpu;
+	uint32_t uptime_ms;
+	uint32_t period_ms;
+	uint64_t period_total;		/* scratch during a sample */
+} mon = {
+	.period_ms = CONFIG_APP_THMON_PERIOD_MS,
+};
+
+static void thmon_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(thmon_actor, actor_bg_q, thmon_handler, 0);
+
+static struct thread_load *find_load(const struct k_thread *thread)
+{
+	struct thread_load *free_slot = NULL;
+
+	for (int i = 0; i < MAX_THREADS; i++) {
+		if (mon.load[i].thread == thread) {
+			return &mon.load[i];
+		}
+		if (!mon.load[i].thread && !free_slot) {
+			free_slot = &mon.load[i];
+		}
+	}
+	if (free_slot) {
+		memset(free_slot, 0, sizeof(*free_slot));
+		free_slot->thread = thread;
+	}
+	return free_slot;
+}
+
+static const char *thread_name(const struct k_thread *thread)
+{
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	return (name && name[0]) ? name : "?";
+}
+
+static void check_budgets(struct thread_load *load)
+{
+	bool over_cpu = load->cpu > CONFIG_APP_THMON_CPU_BUDGET * 100;
+	bool over_stack = load->stack_size &&
+			  load->stack_used * 100 > load->stack_size * CONFIG_APP_THMON_STACK_BUDGET;
+
+	/* Warn on crossing, not on every period spent above the budget. */
+	if (over_cpu && !load->over_cpu) {
+		LOG_WRN("%s over CPU budget: %u.%02u %%", thread_name(load->thread),
+			load->cpu / 100, load->cpu % 100);
+	}
+	if (over_stack && !load->over_stack) {
+		LOG_WRN("%s over stack budget: %zu/%zu bytes", thread_name(load->thread),
+			load->stack_used, load->stack_size);
+	}
+	load->over_cpu = over_cpu;
+	load->over_stack = over_stack;
+}
+
+static void sample_thread(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	struct thread_load *load = find_load(thread);
+	k_thread_runtime_stats_t stats;
+	uint32_t windows;
+	size_t unused;
+
+	ARG_UNUSED(user_data);
+
+	if (!load || k_thread_runtime_stats_get(thread, &stats) != 0) {
+		return;
+	}
+
+	windows = thread->base.usage.num_windows;
+	if (load->baseline) {
+		load->cpu = mon.period_total ?
+			    (uint16_t)((stats.execution_cycles - load->cycles) * 10000 /
+				       mon.period_total) : 0;
+		load->switches = (uint16_t)MIN(windows - load->windows, UINT16_MAX);
+	}
+	/* A new thread shows 0 until it has run for a whole period. */
+	load->baseline = true;
+	load->cycles = stats.execution_cycles;
+	load->windows = windows;
+
+	load->stack_size = thread->stack_info.size;
+	if (k_thread_stack_space_get(thread, &unused) == 0) {
+		load->stack_used = load->stack_size - unused;
+	}
+	load->seen = true;
+	check_budgets(load);
+}
+
+static void thmon_sample(void)
+{
+	k_thread_runtime_stats_t all;
+
+	if (k_thread_runtime_stats_all_get(&all) != 0) {
+		return;
+	}
+	mon.period_total = all.execution_cycles - mon.total;
+	mon.idle_cpu = mon.period_total ?
+		       (uint16_t)((all.idle_cycles - mon.idle) * 10000 / mon.period_total) : 0;
+	mon.total = all.execution_cycles;
+	mon.idle = all.idle_cycles;
+	mon.uptime_ms = k_uptime_get_32();
+
+	for (int i = 0; i < MAX_THREADS; i++) {
+		mon.load[i].seen = false;
+	}
+	k_thread_foreach_unlocked(sample_thread, NULL);
+	/* Forget threads that have exited. */
+	for (int i = 0; i < MAX_THREADS; i++) {
+		if (!mon.load[i].seen) {
+			mon.load[i].thread = NULL;
+		}
+	}
+}
+
+static void thmon_handler(struct actor *actor, uint32_t msgs)
+{
+	ARG_UNUSED(msgs);
+
+	thmon_sample();
+	if (mon.period_ms) {
+		actor_post_delayed(actor, FLAG_SAMPLE, K_MSEC(mon.period_ms));
+	}
+}
+
+size_t thmon_record_encode(uint8_t *buf, size_t size)
+{
+	size_t pos = THMON_HDR_SIZE;
+	uint8_t count = 0;
+	const char *name;
+
+	if (size < THMON_HDR_SIZE) {
+		return 0;
+	}
+	for (int i = 0; i < MAX_THREADS; i++) {
+		struct thread_load *load = &mon.load[i];
+
+		if (!load->thread) {
+			continue;
+		}
+		if (pos + THMON_ENTRY_SIZE > size) {
+			break;
+		}
+		name = thread_name(load->thread);
+		memset(&buf[pos], 0, THMON_NAME_LEN);
+		memcpy(&buf[pos], name, MIN(strlen(name), THMON_NAME_LEN));
+		pos += THMON_NAME_LEN;
+		sys_put_le16(load->cpu, &buf[pos]);
+		sys_put_le16(load->switches, &buf[pos + 2]);
+		sys_put_le16(MIN(load->stack_used, UINT16_MAX), &buf[pos + 4]);
+		sys_put_le16(MIN(load->stack_size, UINT16_MAX), &buf[pos + 6]);
+		pos += 8;
+		count++;
+	}
+	sys_put_le32(mon.uptime_ms, &buf[0]);
+	sys_put_le16(mon.idle_cpu, &buf[4]);
+	buf[6] = count;
+	return pos;
+}
+
+static int thmon_init(void)
+{
+	if (mon.period_ms) {
+		actor_post_delayed(&thmon_actor, FLAG_SAMPLE, K_MSEC(mon.period_ms));
+	}
+	return 0;
+}
+
+SYS_INIT(thmon_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static int cmd_thmon_show(const struct shell *sh, size_t argc, char *argv[])
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	if (mon.period_ms == 0) {
+		/* Not sampling on its own, take one now against the last sample. */
+		thmon_sample();
+	}
+	shell_print(sh, "period %u ms, idle %u.%02u %%", mon.period_ms, mon.idle_cpu / 100,
+		    mon.idle_cpu % 100);
+	shell_print(sh, "%-20s %8s %8s %14s", "thread", "cpu [%]", "switches", "stack");
+	for (int i = 0; i < MAX_THREADS; i++) {
+		struct thread_load *load = &mon.load[i];
+
+		if (!load->thread) {
+			continue;
+		}
+		shell_print(sh, "%-20s %5u.%02u %8u %6zu/%-6zu%s", thread_name(load->thread),
+			    load->cpu / 100, load->cpu % 100, load->switches, load->stack_used,
+			    load->stack_size, (load->over_cpu || load->over_stack) ? " !" : "");
+	}
+	return 0;
+}
+
+static int cmd_thmon_record(const struct shell *sh, size_t argc, char *argv[])
+{
+	uint8_t buf[THMON_HDR_SIZE + MAX_THREADS * THMON_ENTRY_SIZE];
+	size_t len = thmon_record_encode(buf, sizeof(buf));
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_hexdump(sh, buf, len);
+	return 0;
+}
+
+static int cmd_thmon_period(const struct shell *sh, size_t argc, char *argv[])
+{
+	if (argc > 1) {
+		mon.period_ms = strtoul(argv[1], NULL, 0);
+		if (mon.period_ms) {
+			actor_post(&thmon_actor, FLAG_SAMPLE);
+		} else {
+			actor_cancel_delayed(&thmon_actor);
+		}
+	}
+	shell_print(sh, "sampling period %u ms%s", mon.period_ms, mon.period_ms ? "" : " (off)");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(thmon_subcmd,
+	SHELL_CMD_ARG(period, NULL, "[ms]\n\nGet or set the sampling period, 0 stops sampling",
+		      cmd_thmon_period, 1, 1),
+	SHELL_CMD(record, NULL, "Last sample as a binary record", cmd_thmon_record),
+	SHELL_CMD(show, NULL, "CPU load, context switches and stack use per thread",
+		  cmd_thmon_show),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(thmon, &thmon_subcmd, "Thread monitor", NULL);
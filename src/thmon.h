@@ -0,0 +1,19 @@
+#ifndef _THMON_H_
+#define _THMON_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Binary thread monitor record, little endian, for logging:
+ *   header: uptime_ms (u32), idle (u16, 0.01 %), count (u8)
+ *   count x entry: name (8 bytes, not terminated), cpu (u16, 0.01 %),
+ *                  switches (u16), stack_used (u16), stack_size (u16)
+ * Values cover the last completed sampling period.
+ */
+#define THMON_NAME_LEN 8
+#define THMON_HDR_SIZE 7
+#define THMON_ENTRY_SIZE (THMON_NAME_LEN + 8)
+
+size_t thmon_record_encode(uint8_t *buf, size_t size);
+
+#endif /* _THMON_H_ */
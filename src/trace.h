@@ -0,0 +1,20 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Application markers in the Zephyr trace stream. Each marker becomes a CTF
+ * named_event carrying a short name (at most 20 characters) and two 32 bit
+ * arguments, interleaved with the kernel's thread switch and ISR events.
+ * Without CONFIG_APP_TRACE the markers compile to nothing.
+ */
+
+#ifdef CONFIG_APP_TRACE
+#include <zephyr/tracing/tracing.h>
+
+#define APP_TRACE(_name, _arg0, _arg1) \
+	sys_trace_named_event(_name, (uint32_t)(_arg0), (uint32_t)(_arg1))
+#else
+#define APP_TRACE(_name, _arg0, _arg1)
+#endif
+
+#endif /* _TRACE_H_ */
@@ -12,10 +12,15 @@
 #include <stdio.h>
 #include <string.h>
 
-LOG_MODULE_REGISTER(uart_imu, LOG_LEVEL_INF);
+#include "actor.h"
+#include "uart_imu.h"
+#include "sample_ring.h"
+#include "tcm.h"
+#include "metrics.h"
+#include "trace.h"
+#include "prof.h"
 
-#define STACKSIZE 1024
-#define PRIORITY 7
+LOG_MODULE_REGISTER(uart_imu, LOG_LEVEL_INF);
 
 #define IMU0_NODE   DT_ALIAS(imu0)
 #define IMU1_NODE   DT_ALIAS(imu1)
@@ -27,28 +32,61 @@ LOG_MODULE_REGISTER(uart_imu, LOG_LEVEL_INF);
 #error "Unsupported board: uart imu1 devicetree alias is not defined"
 #endif
 
+#define IMU_FRAME_SYNC	CONFIG_APP_IMU_FRAME_SYNC
+#define IMU_FRAME_LEN	CONFIG_APP_IMU_FRAME_LEN
+
+BUILD_ASSERT(IMU_FRAME_LEN <= SAMPLE_IMU_MAX_LEN, "IMU frame does not fit a sample");
+
+METRIC_COUNTER_DEFINE(metric_imu_frames, "imu.frames");
+METRIC_COUNTER_DEFINE(metric_imu_bad_checksum, "imu.bad_checksum");
+METRIC_COUNTER_DEFINE(metric_imu_rx_overflow, "imu.rx_overflow");
+METRIC_COUNTER_DEFINE(metric_imu_rx_error, "imu.rx_error");
+/* Bytes waiting in an IMU RX ring right after the ISR filled it. */
+METRIC_GAUGE_DEFINE(metric_imu_rx_ring, "imu.rx_ring");
+
+PROF_SITE_DEFINE(uart_cb);
+PROF_SITE_DEFINE(process_imu_data);
+
 struct imu_dev {
 	const uint8_t * const name;
+	uint8_t index;
 	const struct device *dev;
 	struct ring_buf *rx_ring_buf;
 	bool rx_error;
 	bool rx_overflow;
+	/* Set while an injector owns the RX ring, see uart_imu_inject_begin(). */
+	bool injecting;
+	/* Frame assembly, only touched from the IMU actor. */
+	uint8_t frame[IMU_FRAME_LEN];
+	uint8_t frame_len;
+	uint32_t frame_stamp;
+	uint32_t frames;
+	uint32_t bad_checksum;
+	uint32_t resync;
+	uint32_t errors;
+	/* Also counted by uart_imu_inject() in the injector's thread. */
+	atomic_t overflows;
 };
 
 #define RING_BUF_SIZE 1024
 
-RING_BUF_DECLARE(imu0_rb, RING_BUF_SIZE);
+/* Ring storage is set up in uart_imu_init() so it can live in DTCM. */
+static uint8_t imu0_rb_data[RING_BUF_SIZE] __app_dtcm_noinit;
+static struct ring_buf imu0_rb __app_dtcm_bss;
 struct imu_dev imu0 = {
 	.name = "imu0",
+	.index = 0,
 	.dev = DEVICE_DT_GET(IMU0_NODE),
 	.rx_ring_buf = &imu0_rb,
 	.rx_error = false,
 	.rx_overflow = false,
 };
 
-RING_BUF_DECLARE(imu1_rb, RING_BUF_SIZE);
+static uint8_t imu1_rb_data[RING_BUF_SIZE] __app_dtcm_noinit;
+static struct ring_buf imu1_rb __app_dtcm_bss;
 struct imu_dev imu1 = {
 	.name = "imu1",
+	.index = 1,
 	.dev = DEVICE_DT_GET(IMU1_NODE),
 	.rx_ring_buf = &imu1_rb,
 	.rx_error = false,
@@ -60,16 +98,26 @@ static struct imu_dev *imu_list[] = {
     &imu1,
 };
 
-K_SEM_DEFINE(imu_sem, 0, 1);
+/* Orders RX re-enable after an overflow against an injector taking over. */
+static struct k_spinlock inject_lock;
+
+enum imu_flag {
+	FLAG_RX,
+	FLAG_NUM,
+};
+
+static void uart_imu_handler(struct actor *actor, uint32_t msgs);
+static ACTOR_DEFINE(imu_actor, actor_sensor_q, uart_imu_handler, CONFIG_APP_DEADLINE_IMU_US);
 
 
 
-static void uart_cb(const struct device *dev, void *ctx)
+static __app_itcm void uart_cb(const struct device *dev, void *ctx)
 {
 	struct imu_dev *imu = (struct imu_dev *)ctx;
 	int ret;
 	uint8_t *buf;
 	uint32_t len;
+	PROF_START(uart_cb);
 
 	while (uart_irq_update(imu->dev) > 0) {
 		ret = uart_irq_rx_ready(imu->dev);
@@ -102,12 +150,58 @@ static void uart_cb(const struct device *dev, void *ctx)
 			imu->rx_error = true;
 			break;
 		}
-        k_sem_give(&imu_sem);
+		metric_set(&metric_imu_rx_ring, ring_buf_size_get(imu->rx_ring_buf));
+        actor_post(&imu_actor, FLAG_RX);
 	}
+	PROF_END(uart_cb);
+}
+
+/*
+ * Frames are IMU_FRAME_LEN bytes starting with IMU_FRAME_SYNC and ending in
+ * the low byte of the sum of all preceding bytes. A frame with a bad
+ * checksum is dropped and the parser hunts for the next sync byte.
+ */
+static __app_itcm void imu_parse(struct imu_dev *imu, const uint8_t *buf, uint32_t len)
+{
+    struct sample *sample;
+    uint8_t sum;
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (imu->frame_len == 0) {
+            if (buf[i] != IMU_FRAME_SYNC) {
+                imu->resync++;
+                continue;
+            }
+            imu->frame_stamp = k_cycle_get_32();
+        }
+        imu->frame[imu->frame_len++] = buf[i];
+        if (imu->frame_len < IMU_FRAME_LEN) {
+            continue;
+        }
+        imu->frame_len = 0;
+
+        sum = 0;
+        for (int j = 0; j < IMU_FRAME_LEN - 1; j++) {
+            sum += imu->frame[j];
+        }
+        if (sum != imu->frame[IMU_FRAME_LEN - 1]) {
+            imu->bad_checksum++;
+            metric_inc(&metric_imu_bad_checksum);
+            continue;
+        }
+
+        sample = sample_claim(SAMPLE_IMU, imu->index, imu->frame_stamp);
+        memcpy(sample->imu, imu->frame, IMU_FRAME_LEN);
+        sample->len = IMU_FRAME_LEN;
+        sample_publish(sample);
+        imu->frames++;
+        metric_inc(&metric_imu_frames);
+    }
 }
 
 static void process_imu_data(struct imu_dev *imu)
 {
+    k_spinlock_key_t key;
     uint8_t *buf;
     uint32_t len;
 
@@ -117,20 +211,28 @@ static void process_imu_data(struct imu_dev *imu)
             break;
         }
 
-        // Process the data in buf
-        LOG_INF("%s: Processed %d bytes", imu->name, len);
-        // for (uint32_t i = 0; i < len; i++) {
-        //     LOG_HEXDUMP_INF(&buf[i], 1, "");
-        // }
+        APP_TRACE("imu_rx", imu->index, len);
+        imu_parse(imu, buf, len);
+        LOG_DBG("%s: Processed %d bytes, %u frames", imu->name, len, imu->frames);
 
         ring_buf_get_finish(imu->rx_ring_buf, len);
     }
     if (imu->rx_overflow) {
         LOG_ERR("%s: RX overflow", imu->name);
+        metric_inc(&metric_imu_rx_overflow);
+        atomic_inc(&imu->overflows);
         imu->rx_overflow = false;
+        /* The ISR disabled RX when the ring filled up, it has been drained now. */
+        key = k_spin_lock(&inject_lock);
+        if (!imu->injecting) {
+            uart_irq_rx_enable(imu->dev);
+        }
+        k_spin_unlock(&inject_lock, key);
     }
     if (imu->rx_error) {
         LOG_ERR("%s: RX error", imu->name);
+        metric_inc(&metric_imu_rx_error);
+        imu->errors++;
         imu->rx_error = false;
     }
 
@@ -138,8 +240,118 @@ static void process_imu_data(struct imu_dev *imu)
 
 
 
-static void uart_imu_thread(void)
+int uart_imu_inject(uint8_t index, const uint8_t *data, size_t len)
 {
+	struct imu_dev *imu;
+	uint32_t put;
+
+	if (index >= ARRAY_SIZE(imu_list)) {
+		return -EINVAL;
+	}
+	imu = imu_list[index];
+
+	put = ring_buf_put(imu->rx_ring_buf, data, len);
+	if (put < len) {
+		/* Counted here, the ISR that would flag it is off while injecting. */
+		metric_inc(&metric_imu_rx_overflow);
+		atomic_inc(&imu->overflows);
+	}
+	metric_set(&metric_imu_rx_ring, ring_buf_size_get(imu->rx_ring_buf));
+	actor_post(&imu_actor, FLAG_RX);
+	return put;
+}
+
+int uart_imu_stats_get(uint8_t index, struct uart_imu_stats *stats)
+{
+	struct imu_dev *imu;
+
+	if (index >= ARRAY_SIZE(imu_list)) {
+		return -EINVAL;
+	}
+	imu = imu_list[index];
+
+	stats->frames = imu->frames;
+	stats->bad_checksum = imu->bad_checksum;
+	stats->resync = imu->resync;
+	stats->overflows = atomic_get(&imu->overflows);
+	stats->errors = imu->errors;
+	return 0;
+}
+
+static int inject_claim(uint8_t index, bool rx_off)
+{
+	struct imu_dev *imu;
+	k_spinlock_key_t key;
+
+	if (index >= ARRAY_SIZE(imu_list)) {
+		return -EINVAL;
+	}
+	imu = imu_list[index];
+
+	key = k_spin_lock(&inject_lock);
+	if (imu->injecting) {
+		k_spin_unlock(&inject_lock, key);
+		return -EBUSY;
+	}
+	imu->injecting = true;
+	if (rx_off) {
+		uart_irq_rx_disable(imu->dev);
+	}
+	k_spin_unlock(&inject_lock, key);
+	return 0;
+}
+
+int uart_imu_inject_begin(uint8_t index)
+{
+	return inject_claim(index, true);
+}
+
+int uart_imu_own(uint8_t index)
+{
+	return inject_claim(index, false);
+}
+
+bool uart_imu_owned(uint8_t index)
+{
+	return index < ARRAY_SIZE(imu_list) && imu_list[index]->injecting;
+}
+
+void uart_imu_inject_end(uint8_t index)
+{
+	struct imu_dev *imu;
+	k_spinlock_key_t key;
+
+	if (index >= ARRAY_SIZE(imu_list)) {
+		return;
+	}
+	imu = imu_list[index];
+
+	key = k_spin_lock(&inject_lock);
+	imu->injecting = false;
+	uart_irq_rx_enable(imu->dev);
+	k_spin_unlock(&inject_lock, key);
+}
+
+static void uart_imu_handler(struct actor *actor, uint32_t msgs)
+{
+    ARG_UNUSED(actor);
+    ARG_UNUSED(msgs);
+
+    for (int i = 0; i < ARRAY_SIZE(imu_list); i++) {
+        struct imu_dev *imu = imu_list[i];
+        // if (imu->rx_overflow || imu->rx_error) {
+        //     continue;
+        // }
+        PROF_START(process_imu_data);
+        process_imu_data(imu);
+        PROF_END(process_imu_data);
+    }
+}
+
+static int uart_imu_init(void)
+{
+	ring_buf_init(&imu0_rb, sizeof(imu0_rb_data), imu0_rb_data);
+	ring_buf_init(&imu1_rb, sizeof(imu1_rb_data), imu1_rb_data);
 
 	uart_irq_rx_disable(imu0.dev);
 	uart_irq_tx_disable(imu0.dev);
@@ -149,21 +361,7 @@ static void uart_imu_thread(void)
 
 	uart_irq_rx_enable(imu0.dev);
 	uart_irq_rx_enable(imu1.dev);
-
-	while (1) {
-        k_sem_take(&imu_sem, K_FOREVER);
-
-        for (int i = 0; i < ARRAY_SIZE(imu_list); i++) {
-            struct imu_dev *imu = imu_list[i];
-            // if (imu->rx_overflow || imu->rx_error) {
-            //     continue;
-            // }
-            process_imu_data(imu);
-        }
-
-        // process_imu_data(&imu0);
-        // process_imu_data(&imu1);
-	}
+	return 0;
 }
 
-K_THREAD_DEFINE(uart_imu_id, STACKSIZE, uart_imu_thread, NULL, NULL, NULL, PRIORITY, 0, 0);
+SYS_INIT(uart_imu_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,45 @@
+#ifndef _UART_IMU_H_
+#define _UART_IMU_H_
+
+#include <zephyr/kernel.h>
+
+/* Per-input counters since boot, see uart_imu_stats_get(). */
+struct uart_imu_stats {
+	uint32_t frames;
+	uint32_t bad_checksum;
+	/* Bytes skipped hunting for a sync byte. */
+	uint32_t resync;
+	uint32_t overflows;
+	uint32_t errors;
+};
+
+int uart_imu_stats_get(uint8_t index, struct uart_imu_stats *stats);
+
+/*
+ * Hand bytes to IMU index as if its UART ISR had read them, for replaying
+ * captures on the target. Bytes that do not fit the RX ring are lost and
+ * counted as an RX overflow, like bytes arriving while RX is disabled.
+ * Thread context only, between uart_imu_inject_begin() and
+ * uart_imu_inject_end(): the ring has a single producer. Returns the bytes
+ * accepted.
+ */
+int uart_imu_inject(uint8_t index, const uint8_t *data, size_t len);
+
+/*
+ * Become the only producer of IMU index: its UART RX interrupt is disabled
+ * and stays off, overflow recovery included, until uart_imu_inject_end().
+ * Returns -EBUSY if another injector owns the input.
+ */
+int uart_imu_inject_begin(uint8_t index);
+void uart_imu_inject_end(uint8_t index);
+
+/*
+ * Own IMU index like uart_imu_inject_begin() but leave its RX interrupt
+ * on, for a replay that writes to the UART itself (the emulator on
+ * native_sim). Ends with uart_imu_inject_end(). Other feeders check
+ * uart_imu_owned() and stay off an owned input.
+ */
+int uart_imu_own(uint8_t index);
+bool uart_imu_owned(uint8_t index);
+
+#endif /* _UART_IMU_H_ */
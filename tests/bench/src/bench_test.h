@@ -0,0 +1,25 @@
+#ifndef _BENCH_TEST_H_
+#define _BENCH_TEST_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+static inline uint32_t bench_ns_per_op(uint32_t cycles, uint32_t n)
+{
+	return (uint32_t)(k_cyc_to_ns_floor64(cycles) / n);
+}
+
+/*
+ * Print a result in a fixed format for log scraping, then check its limit
+ * where the clock means something (CONFIG_BENCH_LIMITS).
+ */
+#define BENCH_CHECK(_name, _ns, _limit)                                        \
+	do {                                                                   \
+		TC_PRINT("bench %-16s %10u ns/op, limit %u\n", _name, _ns, _limit); \
+		if (IS_ENABLED(CONFIG_BENCH_LIMITS)) {                         \
+			zassert_true((_ns) <= (_limit), "%s: %u ns/op over %u", \
+				     _name, _ns, _limit);                      \
+		}                                                              \
+	} while (0)
+
+#endif /* _BENCH_TEST_H_ */
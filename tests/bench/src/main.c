@@ -0,0 +1,128 @@
+/*
+ * Data path micro-benchmarks with pass/fail limits. Each case times
+ * CONFIG_BENCH_ITERATIONS operations, checks they did their work, and
+ * asserts the time per operation against its CONFIG_BENCH_LIMIT_* value.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <string.h>
+
+#include "channels.h"
+#include "sample_ring.h"
+#include "config_svc.h"
+#include "bench.h"
+#include "bench_test.h"
+
+#define N CONFIG_BENCH_ITERATIONS
+
+/* CONFIG_APP_IMU_FRAME_LEN default of the application. */
+#define IMU_FRAME_LEN 11
+
+/* Keeps the compiler from dropping work whose result is not checked. */
+static volatile uint32_t sink;
+
+ZTEST(bench, test_event_settings)
+{
+	uint32_t hits, ns;
+
+	ns = bench_ns_per_op(bench_event_settings(N, &hits), N);
+
+	zassert_equal(hits, N, "dispatched %u/%u", hits, N);
+	BENCH_CHECK("settings_event", ns, CONFIG_BENCH_LIMIT_EVENT_NS);
+}
+
+ZTEST(bench, test_event_zbus)
+{
+	uint32_t hits, ns;
+
+	ns = bench_ns_per_op(bench_event_zbus(N, &hits), N);
+
+	zassert_equal(hits, N, "dispatched %u/%u", hits, N);
+	BENCH_CHECK("zbus_event", ns, CONFIG_BENCH_LIMIT_EVENT_NS);
+}
+
+/* Put/get pair at FSR sample size, the hand-off the sensor path used before the ring. */
+K_MSGQ_DEFINE(bench_msgq, sizeof(struct fsr_data), 16, 4);
+
+ZTEST(bench, test_msgq_fsr)
+{
+	struct fsr_data in = { .value = { 1, 2, 3, 4 } };
+	struct fsr_data out;
+	uint32_t start, ns;
+	uint32_t i;
+
+	start = k_cycle_get_32();
+	for (i = 0; i < N; i++) {
+		in.value[0] = (uint16_t)i;
+		if (k_msgq_put(&bench_msgq, &in, K_NO_WAIT) ||
+		    k_msgq_get(&bench_msgq, &out, K_NO_WAIT) || out.value[0] != in.value[0]) {
+			break;
+		}
+	}
+	ns = bench_ns_per_op(k_cycle_get_32() - start, N);
+
+	zassert_equal(i, N, "put/get pair %u failed", i);
+	BENCH_CHECK("msgq_fsr", ns, CONFIG_BENCH_LIMIT_MSGQ_NS);
+}
+
+/* The uart_imu.c pattern: claim, fill and finish one frame, then claim, sum and finish it. */
+RING_BUF_DECLARE(bench_rb, 256);
+
+ZTEST(bench, test_ringbuf_frame)
+{
+	uint8_t *buf;
+	uint32_t len, start, ns;
+	uint32_t bytes = 0;
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < N; i++) {
+		len = ring_buf_put_claim(&bench_rb, &buf, IMU_FRAME_LEN);
+		memset(buf, (uint8_t)i, len);
+		ring_buf_put_finish(&bench_rb, len);
+
+		while ((len = ring_buf_get_claim(&bench_rb, &buf, IMU_FRAME_LEN))) {
+			for (uint32_t j = 0; j < len; j++) {
+				sink += buf[j];
+			}
+			bytes += len;
+			ring_buf_get_finish(&bench_rb, len);
+		}
+	}
+	ns = bench_ns_per_op(k_cycle_get_32() - start, N);
+
+	zassert_true(ring_buf_is_empty(&bench_rb), "frames left in the ring");
+	zassert_equal(bytes, N * IMU_FRAME_LEN, "moved %u bytes", bytes);
+	BENCH_CHECK("ringbuf_frame", ns, CONFIG_BENCH_LIMIT_RINGBUF_NS);
+}
+
+/*
+ * What the config characteristic handlers do around the ATT copy: a read
+ * takes a snapshot and picks the field, a write updates the snapshot in
+ * RAM. Saving to flash is the service actor's business and not timed.
+ */
+ZTEST(bench, test_config_rw)
+{
+	struct assist_config cfg;
+	uint32_t version, start, ns;
+	uint16_t value;
+
+	config_snapshot(&cfg);
+	version = cfg.version;
+
+	start = k_cycle_get_32();
+	for (uint32_t i = 0; i < N; i++) {
+		config_snapshot(&cfg);
+		value = config_field(&cfg, ASSIST_FIELD_MANUAL);
+		config_update(ASSIST_FIELD_MANUAL, value + 1);
+	}
+	ns = bench_ns_per_op(k_cycle_get_32() - start, N);
+
+	config_snapshot(&cfg);
+	zassert_equal(cfg.version, version + N, "version %u after %u writes", cfg.version, N);
+	zassert_equal(cfg.manual, (uint16_t)N, "manual %u", cfg.manual);
+	BENCH_CHECK("config_rw", ns, CONFIG_BENCH_LIMIT_CONFIG_NS);
+}
+
+ZTEST_SUITE(bench, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,273 @@
+/*
+ * The application's central role against the simulated FSR and controller
+ * peripherals of ../peripheral. bt_main.c, fsr.c and controller.c run as in
+ * the firmware; this file stands in for the event, LED and CAN modules and
+ * drives the Bluetooth manager through btsrv_chan as events.c does.
+ *
+ * "central_pair" pairs both peripherals on a fresh flash. "central_bonded"
+ * boots on the flash the first run left and measures:
+ *
+ * - time from boot to the first notification of each link,
+ * - reconnect time (disconnect to connected) and resume time (disconnect to
+ *   the first notification) after forced disconnects,
+ * - notification delivery latency and loss.
+ *
+ * The peripherals stamp every notification with their uptime. All devices
+ * of a simulation boot at the same simulated instant, so the central's
+ * uptime at reception minus that stamp is the delivery latency. Loss comes
+ * from gaps in the peripherals' sequence numbers.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/zbus/zbus.h>
+
+#include "bstests.h"
+#include "babblekit/testcase.h"
+#include "babblekit/flags.h"
+
+#include "bt_main.h"
+#include "channels.h"
+#include "sample_ring.h"
+
+/* Pass/fail limits of central_bonded. */
+#define FIRST_DATA_LIMIT_MS	3000
+#define RECONNECT_LIMIT_MS	1000
+#define RESUME_LIMIT_MS		2000
+#define FSR_LATENCY_LIMIT_US	30000
+#define CTRL_LATENCY_LIMIT_MS	100
+/* One notification may be in flight at each forced disconnect. */
+#define DROP_ROUNDS		3
+#define LOSS_LIMIT		DROP_ROUNDS
+
+#define PAIR_TIMEOUT		K_SECONDS(15)
+#define LINK_TIMEOUT		K_SECONDS(10)
+#define STEADY_PERIOD		K_SECONDS(5)
+
+DEFINE_FLAG_STATIC(flag_paired);
+
+/* Delivery statistics of one link, from the samples it put in the ring. */
+struct rx_stats {
+	const char *name;
+	uint32_t received;
+	uint32_t lost;
+	uint16_t last_seq;
+	uint32_t latency_sum;
+	uint32_t latency_max;
+};
+
+static struct rx_stats fsr_rx = { .name = "FSR" };
+static struct rx_stats ctrl_rx = { .name = "Controller" };
+
+SAMPLE_READER_DEFINE(bsim_reader);
+
+/* Stand-ins for the modules not built here. */
+static void event_listener(const struct zbus_channel *chan)
+{
+	if (chan == &pairing_chan) {
+		const struct pairing_msg *msg = zbus_chan_const_msg(chan);
+
+		if (msg->complete) {
+			SET_FLAG(flag_paired);
+		}
+	}
+}
+
+static void ignore_listener(const struct zbus_channel *chan)
+{
+	ARG_UNUSED(chan);
+}
+
+ZBUS_LISTENER_DEFINE(event_lis, event_listener);
+ZBUS_LISTENER_DEFINE(led_lis, ignore_listener);
+ZBUS_LISTENER_DEFINE(can_lis, ignore_listener);
+
+static void btsrv(enum btsrv_cmd cmd)
+{
+	struct btsrv_msg msg = { .cmd = cmd };
+
+	TEST_ASSERT(channel_publish(&btsrv_chan, &msg) == 0, "btsrv publish failed");
+}
+
+static void rx_record(struct rx_stats *rx, uint16_t seq, uint32_t latency)
+{
+	if (rx->received) {
+		rx->lost += (uint16_t)(seq - rx->last_seq - 1);
+	}
+	rx->last_seq = seq;
+	rx->received++;
+	rx->latency_sum += latency;
+	rx->latency_max = MAX(rx->latency_max, latency);
+}
+
+/*
+ * FSR: value[0] sequence, value[2..3] send uptime in us.
+ * Controller: value sequence, mode send uptime in ms (low 16 bits).
+ */
+static void sample_cb(const struct sample *sample, void *user_data)
+{
+	uint64_t rx_us = k_cyc_to_us_floor64(sample->cycles);
+	uint32_t sent_us;
+	uint16_t rx_ms;
+
+	ARG_UNUSED(user_data);
+
+	switch (sample->tag) {
+	case SAMPLE_FSR:
+		sent_us = ((uint32_t)sample->fsr.value[2] << 16) | sample->fsr.value[3];
+		rx_record(&fsr_rx, sample->fsr.value[0], (uint32_t)rx_us - sent_us);
+		break;
+	case SAMPLE_CONTROLLER:
+		rx_ms = (uint16_t)(rx_us / USEC_PER_MSEC);
+		rx_record(&ctrl_rx, sample->controller.value,
+			  (uint16_t)(rx_ms - sample->controller.mode));
+		break;
+	default:
+		break;
+	}
+}
+
+/* Follow the ring until done() holds; false on timeout. */
+static bool run_until(bool (*done)(void), k_timeout_t timeout)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+
+	while (!done || !done()) {
+		if (sys_timepoint_expired(end)) {
+			return done == NULL;
+		}
+		sample_reader_wait(&bsim_reader, K_MSEC(10));
+		while (sample_reader_drain(&bsim_reader, sample_cb, NULL, 32)) {
+		}
+	}
+	return true;
+}
+
+static bool links_bonded(void)
+{
+	return IS_FLAG_SET(flag_paired) &&
+	       !bt_addr_le_eq(&fsr_srvc.bond_addr, BT_ADDR_LE_ANY) &&
+	       !bt_addr_le_eq(&controller_client.bond_addr, BT_ADDR_LE_ANY) &&
+	       fsr_rx.received && ctrl_rx.received;
+}
+
+static bool links_have_data(void)
+{
+	return fsr_srvc.stats.first_data_ms && controller_client.stats.first_data_ms;
+}
+
+static struct gatt_client *dropped;
+
+static bool dropped_resumed(void)
+{
+	return dropped->stats.resume_ms != 0;
+}
+
+static void drop_and_resume(struct gatt_client *client)
+{
+	struct link_stats *ls = &client->stats;
+
+	TEST_ASSERT(client->conn, "%s not connected", client->name);
+	dropped = client;
+	/* Set again by the first notification after the reconnect. */
+	ls->resume_ms = 0;
+	/* As "link drop <client>", disconnected() reconnects. */
+	TEST_ASSERT(bt_conn_disconnect(client->conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN) == 0,
+		    "%s: disconnect failed", client->name);
+	TEST_ASSERT(run_until(dropped_resumed, LINK_TIMEOUT), "%s did not resume",
+		    client->name);
+
+	printk("%s: reconnect %u ms, resume %u ms\n", client->name, ls->reconnect_ms,
+	       ls->resume_ms);
+	TEST_ASSERT(ls->reconnect_ms <= RECONNECT_LIMIT_MS, "%s: reconnect %u ms over %u",
+		    client->name, ls->reconnect_ms, RECONNECT_LIMIT_MS);
+	TEST_ASSERT(ls->resume_ms <= RESUME_LIMIT_MS, "%s: resume %u ms over %u", client->name,
+		    ls->resume_ms, RESUME_LIMIT_MS);
+
+	/* Let the link settle before the next one goes down. */
+	run_until(NULL, K_SECONDS(1));
+}
+
+static void rx_report(const struct rx_stats *rx, const char *unit, uint32_t limit)
+{
+	printk("%s: %u received, %u lost, latency avg %u max %u %s\n", rx->name, rx->received,
+	       rx->lost, rx->received ? rx->latency_sum / rx->received : 0, rx->latency_max,
+	       unit);
+	TEST_ASSERT(rx->received, "%s: nothing received", rx->name);
+	TEST_ASSERT(rx->lost <= LOSS_LIMIT, "%s: %u lost over %u", rx->name, rx->lost,
+		    LOSS_LIMIT);
+	TEST_ASSERT(rx->latency_max <= limit, "%s: latency %u %s over %u", rx->name,
+		    rx->latency_max, unit, limit);
+}
+
+static void test_central_pair(void)
+{
+	TEST_ASSERT(sample_reader_register(&bsim_reader) == 0, "no reader slot");
+
+	btsrv(BTSRV_START);
+	btsrv(BTSRV_PAIR);
+	TEST_ASSERT(run_until(links_bonded, PAIR_TIMEOUT), "pairing did not complete");
+
+	/* Give the bond and peer saves time to reach flash. */
+	run_until(NULL, K_SECONDS(1));
+	TEST_PASS("both peripherals bonded");
+}
+
+static void test_central_bonded(void)
+{
+	TEST_ASSERT(sample_reader_register(&bsim_reader) == 0, "no reader slot");
+
+	btsrv(BTSRV_START);
+	TEST_ASSERT(run_until(links_have_data, LINK_TIMEOUT), "no notifications after boot");
+
+	printk("first notification after boot: FSR %u ms, Controller %u ms\n",
+	       fsr_srvc.stats.first_data_ms, controller_client.stats.first_data_ms);
+	TEST_ASSERT(fsr_srvc.stats.first_data_ms <= FIRST_DATA_LIMIT_MS,
+		    "FSR: first notification at %u ms", fsr_srvc.stats.first_data_ms);
+	TEST_ASSERT(controller_client.stats.first_data_ms <= FIRST_DATA_LIMIT_MS,
+		    "Controller: first notification at %u ms",
+		    controller_client.stats.first_data_ms);
+
+	run_until(NULL, STEADY_PERIOD);
+	for (int i = 0; i < DROP_ROUNDS; i++) {
+		drop_and_resume(&fsr_srvc);
+		drop_and_resume(&controller_client);
+	}
+	run_until(NULL, STEADY_PERIOD);
+
+	rx_report(&fsr_rx, "us", FSR_LATENCY_LIMIT_US);
+	rx_report(&ctrl_rx, "ms", CTRL_LATENCY_LIMIT_MS);
+	TEST_PASS("links timed within limits");
+}
+
+static const struct bst_test_instance test_def[] = {
+	{
+		.test_id = "central_pair",
+		.test_descr = "Pair the FSR and controller peripherals on a fresh flash",
+		.test_main_f = test_central_pair,
+	},
+	{
+		.test_id = "central_bonded",
+		.test_descr = "Boot bonded, time first notification, reconnects, latency and loss",
+		.test_main_f = test_central_bonded,
+	},
+	BSTEST_END_MARKER,
+};
+
+static struct bst_test_list *test_central_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_def);
+}
+
+bst_test_install_t test_installers[] = {
+	test_central_install,
+	NULL,
+};
+
+int main(void)
+{
+	bst_main();
+	return 0;
+}
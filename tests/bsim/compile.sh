@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+# Build the central and peripheral images for nrf52_bsim into
+# ${BSIM_OUT_PATH}/bin. Needs ZEPHYR_BASE, BSIM_OUT_PATH and BSIM_COMPONENTS_PATH.
+set -ue
+
+: "${ZEPHYR_BASE:?ZEPHYR_BASE must be set to point to the zephyr root directory}"
+
+source ${ZEPHYR_BASE}/tests/bsim/compile.source
+
+app_root=$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)
+
+app=tests/bsim/central exe_name=bs_${BOARD_TS}_rehab_bot_central compile
+app=tests/bsim/peripheral exe_name=bs_${BOARD_TS}_rehab_bot_peripheral compile
+wait_for_background_jobs
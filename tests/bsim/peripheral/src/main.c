@@ -0,0 +1,266 @@
+/*
+ * Simulated FSR and controller peripherals for ../central.
+ *
+ * Both advertise like the real devices: manufacturer data with the pairing
+ * flag while they have no bond, then the service UUID, which is the order
+ * eir_found() in bt_main.c expects. Each requests security on connect.
+ *
+ * "fsr" notifies 8 bytes every 10 ms: sequence, 0, and its uptime in us as
+ * two be16 halves. "controller" indicates 4 bytes every 100 ms: sequence
+ * (never 0, which means stop) and its uptime in ms. The sequence only moves
+ * when the stack took the notification, so a gap at the central is a loss
+ * on the air or in its host.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "bstests.h"
+#include "babblekit/testcase.h"
+
+#define MFG_FLAG_PAIRING	0x8000
+
+#define FSR_PERIOD		K_MSEC(10)
+#define CONTROLLER_PERIOD	K_MSEC(100)
+/* Handle controller.c subscribes to without discovery. */
+#define CONTROLLER_VALUE_HANDLE	0x0012
+
+static const struct bt_uuid_128 fsr_svc_uuid = BT_UUID_INIT_128(
+	BT_UUID_128_ENCODE(0xe2505f48, 0x01a0, 0x11f0, 0x9cd2, 0x0242ac120002));
+static const struct bt_uuid_128 fsr_chrc_uuid = BT_UUID_INIT_128(
+	BT_UUID_128_ENCODE(0xe2506240, 0x01a0, 0x11f0, 0x9cd2, 0x0242ac120002));
+static const struct bt_uuid_128 controller_svc_uuid = BT_UUID_INIT_128(
+	BT_UUID_128_ENCODE(0xa8a618ba, 0x16bc, 0x11f0, 0x9cd2, 0x0242ac120002));
+static const struct bt_uuid_128 controller_chrc_uuid = BT_UUID_INIT_128(
+	BT_UUID_128_ENCODE(0xa8a61aa4, 0x16bc, 0x11f0, 0x9cd2, 0x0242ac120002));
+
+static struct bt_conn *peer;
+static bool subscribed;
+static atomic_t indicating;
+
+static void ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	ARG_UNUSED(attr);
+
+	subscribed = value != 0;
+	printk("CCC %04x\n", value);
+}
+
+static struct bt_gatt_attr fsr_attrs[] = {
+	BT_GATT_PRIMARY_SERVICE(&fsr_svc_uuid),
+	BT_GATT_CHARACTERISTIC(&fsr_chrc_uuid.uuid, BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE,
+			       NULL, NULL, NULL),
+	BT_GATT_CCC(ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+};
+
+static struct bt_gatt_attr controller_attrs[] = {
+	BT_GATT_PRIMARY_SERVICE(&controller_svc_uuid),
+	BT_GATT_CHARACTERISTIC(&controller_chrc_uuid.uuid, BT_GATT_CHRC_INDICATE,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+};
+
+static struct bt_gatt_service fsr_svc = BT_GATT_SERVICE(fsr_attrs);
+static struct bt_gatt_service controller_svc = BT_GATT_SERVICE(controller_attrs);
+
+/* Manufacturer data, then the one service UUID. */
+static uint8_t mfg_data[2];
+static struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR),
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data, sizeof(mfg_data)),
+	BT_DATA(BT_DATA_UUID128_ALL, NULL, BT_UUID_SIZE_128),
+};
+
+static void count_bond(const struct bt_bond_info *info, void *user_data)
+{
+	ARG_UNUSED(info);
+	(*(int *)user_data)++;
+}
+
+static void adv_start(void)
+{
+	int bonds = 0;
+	int err;
+
+	bt_foreach_bond(BT_ID_DEFAULT, count_bond, &bonds);
+	sys_put_be16(bonds ? 0 : MFG_FLAG_PAIRING, mfg_data);
+
+	err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ad, ARRAY_SIZE(ad), NULL, 0);
+	if (err && err != -EALREADY) {
+		TEST_FAIL("Advertising failed (err %d)", err);
+	}
+}
+
+static void adv_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	adv_start();
+}
+
+static K_WORK_DEFINE(adv_work, adv_work_handler);
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		return;
+	}
+	peer = bt_conn_ref(conn);
+	/* The real sensors secure the link themselves, the central only accepts. */
+	err = bt_conn_set_security(conn, BT_SECURITY_L2);
+	if (err) {
+		printk("Security request failed (err %d)\n", err);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	printk("Disconnected (reason 0x%02x)\n", reason);
+	subscribed = false;
+	atomic_clear(&indicating);
+	if (peer == conn) {
+		bt_conn_unref(peer);
+		peer = NULL;
+	}
+}
+
+/* Advertising does not resume by itself once the connection object is free. */
+static void recycled(void)
+{
+	k_work_submit(&adv_work);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.recycled = recycled,
+};
+
+static void peripheral_start(struct bt_gatt_service *svc, const struct bt_uuid_128 *uuid)
+{
+	int err;
+
+	ad[2].data = uuid->val;
+
+	err = bt_enable(NULL);
+	TEST_ASSERT(err == 0, "Bluetooth init failed (err %d)", err);
+	err = settings_load();
+	TEST_ASSERT(err == 0, "Settings load failed (err %d)", err);
+	err = bt_gatt_service_register(svc);
+	TEST_ASSERT(err == 0, "Service register failed (err %d)", err);
+	bt_set_bondable(true);
+	adv_start();
+}
+
+static void test_fsr(void)
+{
+	const struct bt_gatt_attr *attr = &fsr_attrs[2];
+	uint16_t seq = 0;
+	uint8_t buf[8];
+	uint32_t now;
+
+	peripheral_start(&fsr_svc, &fsr_svc_uuid);
+
+	while (true) {
+		k_sleep(FSR_PERIOD);
+		if (!peer || !subscribed) {
+			continue;
+		}
+		now = (uint32_t)k_cyc_to_us_floor64(k_cycle_get_32());
+		sys_put_be16(seq, &buf[0]);
+		sys_put_be16(0, &buf[2]);
+		sys_put_be16(now >> 16, &buf[4]);
+		sys_put_be16(now & 0xffff, &buf[6]);
+		if (bt_gatt_notify(peer, attr, buf, sizeof(buf)) == 0) {
+			if (seq++ == 0) {
+				TEST_PASS("FSR notifying");
+			}
+		}
+	}
+}
+
+static void indicate_cb(struct bt_conn *conn, struct bt_gatt_indicate_params *params, uint8_t err)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(params);
+	ARG_UNUSED(err);
+}
+
+static void indicate_destroy(struct bt_gatt_indicate_params *params)
+{
+	ARG_UNUSED(params);
+	atomic_clear(&indicating);
+}
+
+static void test_controller(void)
+{
+	static struct bt_gatt_indicate_params params;
+	static uint8_t buf[4];
+	uint16_t seq = 1;
+
+	peripheral_start(&controller_svc, &controller_svc_uuid);
+	TEST_ASSERT(bt_gatt_attr_get_handle(&controller_attrs[2]) == CONTROLLER_VALUE_HANDLE,
+		    "Controller value at 0x%04x, not 0x%04x",
+		    bt_gatt_attr_get_handle(&controller_attrs[2]), CONTROLLER_VALUE_HANDLE);
+
+	while (true) {
+		k_sleep(CONTROLLER_PERIOD);
+		if (!peer || !subscribed || atomic_set(&indicating, 1)) {
+			continue;
+		}
+		sys_put_be16(seq, &buf[0]);
+		sys_put_be16((uint16_t)k_uptime_get_32(), &buf[2]);
+		params = (struct bt_gatt_indicate_params){
+			.attr = &controller_attrs[2],
+			.func = indicate_cb,
+			.destroy = indicate_destroy,
+			.data = buf,
+			.len = sizeof(buf),
+		};
+		if (bt_gatt_indicate(peer, &params)) {
+			atomic_clear(&indicating);
+			continue;
+		}
+		if (seq++ == 1) {
+			TEST_PASS("Controller indicating");
+		}
+		/* 0 would read as "stop" at the central. */
+		if (seq == 0) {
+			seq = 1;
+		}
+	}
+}
+
+static const struct bst_test_instance test_def[] = {
+	{
+		.test_id = "fsr",
+		.test_descr = "FSR insole: notify a sequence and send time every 10 ms",
+		.test_main_f = test_fsr,
+	},
+	{
+		.test_id = "controller",
+		.test_descr = "Hand controller: indicate a sequence and send time every 100 ms",
+		.test_main_f = test_controller,
+	},
+	BSTEST_END_MARKER,
+};
+
+static struct bst_test_list *test_peripheral_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_def);
+}
+
+bst_test_install_t test_installers[] = {
+	test_peripheral_install,
+	NULL,
+};
+
+int main(void)
+{
+	bst_main();
+	return 0;
+}
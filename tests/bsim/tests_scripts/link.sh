@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+# The application's central against a simulated FSR and hand controller.
+# The first simulation pairs them on erased flash, the second boots on that
+# flash and measures time to first notification, reconnects after forced
+# disconnects, and notification latency and loss. Run compile.sh first.
+set -ue
+
+source ${ZEPHYR_BASE}/tests/bsim/sh_common.source
+
+simulation_id="rehab_bot_link"
+verbosity_level=2
+EXECUTE_TIMEOUT=120
+
+central_exe="./bs_${BOARD_TS}_rehab_bot_central"
+peripheral_exe="./bs_${BOARD_TS}_rehab_bot_peripheral"
+flash="${simulation_id}"
+
+cd ${BSIM_OUT_PATH}/bin
+
+Execute ${central_exe} -v=${verbosity_level} -s=${simulation_id}_pair -d=0 \
+  -testid=central_pair -flash=${flash}_central.bin -flash_erase
+Execute ${peripheral_exe} -v=${verbosity_level} -s=${simulation_id}_pair -d=1 \
+  -testid=fsr -flash=${flash}_fsr.bin -flash_erase
+Execute ${peripheral_exe} -v=${verbosity_level} -s=${simulation_id}_pair -d=2 \
+  -testid=controller -flash=${flash}_controller.bin -flash_erase
+Execute ./bs_2G4_phy_v1 -v=${verbosity_level} -s=${simulation_id}_pair -D=3 -sim_length=20e6
+
+wait_for_background_jobs
+
+Execute ${central_exe} -v=${verbosity_level} -s=${simulation_id}_bonded -d=0 \
+  -testid=central_bonded -flash=${flash}_central.bin -flash_rm
+Execute ${peripheral_exe} -v=${verbosity_level} -s=${simulation_id}_bonded -d=1 \
+  -testid=fsr -flash=${flash}_fsr.bin -flash_rm
+Execute ${peripheral_exe} -v=${verbosity_level} -s=${simulation_id}_bonded -d=2 \
+  -testid=controller -flash=${flash}_controller.bin -flash_rm
+Execute ./bs_2G4_phy_v1 -v=${verbosity_level} -s=${simulation_id}_bonded -D=3 -sim_length=60e6
+
+wait_for_background_jobs